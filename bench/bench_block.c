@@ -0,0 +1,93 @@
+/*
+ * Block copy/fill benchmark
+ *
+ * Moves data between two regions with the byte at a time paging calls
+ * (__read/__write, what a READ/WRITE loop costs minus the dumps) and
+ * with the page chunked __copy/__fill, and reports the throughput.
+ *
+ * Usage: bench_block [region size] [rounds]
+ */
+
+#include "mm.h"
+#include "libmem.h"
+#include "loader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_RAMSZ (1 << 21)
+#define BENCH_SWPSZ (1 << 24)
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	int size = (argc > 1) ? atoi(argv[1]) : 65536;
+	int rounds = (argc > 2) ? atoi(argv[2]) : 20;
+	struct memphy_struct mram, mswp[PAGING_MAX_MMSWP];
+	struct pcb_t *proc = calloc(1, sizeof(*proc));
+	double t, tbyte_copy, tblk_copy, tbyte_fill, tblk_fill;
+	int sit, addr, r, i;
+	BYTE data;
+
+	init_memphy(&mram, BENCH_RAMSZ, 1);
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+		init_memphy(&mswp[sit], BENCH_SWPSZ, 1);
+	proc->mm = malloc(sizeof(struct mm_struct));
+	init_mm(proc->mm, proc);
+	proc->mram = &mram;
+	proc->mswp = (struct memphy_struct **)&mswp;
+	proc->active_mswp = &mswp[0];
+
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		return 1;
+	if (__alloc(proc, PAGING_VMA_HEAP, 0, size, &addr) != 0 ||
+	    __alloc(proc, PAGING_VMA_HEAP, 1, size, &addr) != 0)
+		return 1;
+
+	t = now_sec();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < size; i++)
+			__write(proc, 0, 0, i, (BYTE)r);
+	tbyte_fill = now_sec() - t;
+
+	t = now_sec();
+	for (r = 0; r < rounds; r++)
+		__fill(proc, 0, 0, (BYTE)r, size);
+	tblk_fill = now_sec() - t;
+
+	t = now_sec();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < size; i++) {
+			__read(proc, 0, 0, i, &data);
+			__write(proc, 0, 1, i, data);
+		}
+	tbyte_copy = now_sec() - t;
+
+	t = now_sec();
+	for (r = 0; r < rounds; r++)
+		__copy(proc, 0, 0, 1, 0, size);
+	tblk_copy = now_sec() - t;
+
+	fprintf(stderr, "%d rounds over %d byte regions\n", rounds, size);
+	fprintf(stderr, "%-6s %14s %14s %8s\n", "", "byte MB/s", "block MB/s", "speedup");
+	fprintf(stderr, "%-6s %14.2f %14.2f %7.0fx\n", "fill",
+		rounds * (double)size / tbyte_fill / 1e6,
+		rounds * (double)size / tblk_fill / 1e6, tbyte_fill / tblk_fill);
+	fprintf(stderr, "%-6s %14.2f %14.2f %7.0fx\n", "copy",
+		rounds * (double)size / tbyte_copy / 1e6,
+		rounds * (double)size / tblk_copy / 1e6, tbyte_copy / tblk_copy);
+
+	free_pcb_mm(proc);
+	free(proc->sc_stats);
+	free(proc->sc_ring);
+	free(proc);
+	return 0;
+}
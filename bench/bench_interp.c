@@ -0,0 +1,200 @@
+/*
+ * Interpreter dispatch benchmark
+ *
+ * Runs a CALC only program, a memory program (one region, then
+ * write/read pairs) and a three instruction counted loop through the old
+ * switch interpreter, one instruction per call, and through run_budget()
+ * on the pre-decoded handlers, BENCH_BUDGET instructions per call, and
+ * reports instructions per second for each. A failing instruction aborts
+ * the run.
+ *
+ * Usage: bench_interp [instructions]
+ */
+
+#include "cpu.h"
+#include "loader.h"
+#include "mm.h"
+#include "libmem.h"
+#include "syscall.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Small RAM, the paging library dumps it at every access */
+#define BENCH_RAMSZ (1 << 16)
+#define BENCH_SWPSZ (1 << 24)
+/* Instructions per run_budget() call */
+#define BENCH_BUDGET 1024
+
+int calc(struct pcb_t *proc);
+
+static struct memphy_struct mram, mswp[PAGING_MAX_MMSWP];
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* run() as it was before pre-decoding, the baseline */
+static int run_switch(struct pcb_t *proc)
+{
+	if (proc->pc >= proc->code->size)
+		return 1;
+
+	struct inst_t ins = proc->code->text[proc->pc];
+	proc->pc++;
+	int stat = 1;
+	switch (ins.opcode) {
+	case CALC:
+		stat = calc(proc);
+		break;
+	case ALLOC:
+		stat = liballoc(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+		break;
+	case FREE:
+		stat = libfree(proc, ins.arg_0);
+		break;
+	case READ:
+		stat = libread(proc, ins.arg_0, ins.arg_1, &ins.arg_2);
+		break;
+	case WRITE:
+		stat = libwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+		break;
+	case SYSCALL:
+		stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
+		break;
+	default:
+		stat = 1;
+	}
+	return stat;
+}
+
+static struct code_seg_t *make_code(uint32_t size, int memory)
+{
+	struct code_seg_t *code = calloc(1, sizeof(*code));
+	uint32_t i;
+
+	code->size = size;
+	code->refcnt = 1;
+	code->text = calloc(size, sizeof(struct inst_t));
+	for (i = 0; i < size && memory; i++) {
+		struct inst_t *ins = &code->text[i];
+
+		if (i == 0) {
+			ins->opcode = ALLOC;
+			ins->arg_0 = 4096;
+			continue;
+		}
+		if (i % 4 == 3)
+			continue; /* a CALC between accesses */
+		ins->opcode = (i & 1) ? WRITE : READ;
+		ins->arg_0 = (i & 1) ? (i & 0x7f) : 0;
+		ins->arg_1 = (i & 1) ? 0 : (i % 4096);
+		ins->arg_2 = (i & 1) ? (i % 4096) : 0;
+	}
+	decode_code(code);
+	return code;
+}
+
+static struct pcb_t *new_proc(struct code_seg_t *code)
+{
+	struct pcb_t *proc = calloc(1, sizeof(*proc));
+
+	proc->code = code;
+	proc->mm = malloc(sizeof(struct mm_struct));
+	init_mm(proc->mm, proc);
+	proc->mram = &mram;
+	proc->mswp = (struct memphy_struct **)&mswp;
+	proc->active_mswp = &mswp[0];
+	proc->state = PROC_RUNNING;
+	return proc;
+}
+
+static void free_proc(struct pcb_t *proc)
+{
+	free_pcb_mm(proc);
+	free(proc->sc_stats);
+	free(proc->sc_ring);
+	free(proc);
+}
+
+/* calc; calc; loop back until the counter drops to 0 */
+static struct code_seg_t *make_loop(uint32_t iterations)
+{
+	struct code_seg_t *code = calloc(1, sizeof(*code));
+
+	code->size = 4;
+	code->refcnt = 1;
+	code->text = calloc(code->size, sizeof(struct inst_t));
+	code->text[0] = (struct inst_t){ .opcode = SET, .arg_0 = 1, .arg_1 = iterations };
+	code->text[1] = (struct inst_t){ .opcode = CALC };
+	code->text[2] = (struct inst_t){ .opcode = CALC };
+	code->text[3] = (struct inst_t){ .opcode = LOOP, .arg_0 = 1, .arg_1 = 1 };
+	decode_code(code);
+	return code;
+}
+
+/* mode 0: switch (straight-line code only), 1: run_budget() */
+static double ips(struct code_seg_t *code, int mode)
+{
+	struct pcb_t *proc = new_proc(code);
+	double start = now_sec(), elapsed;
+	unsigned long ninst = 0;
+	uint32_t n = 1;
+	int stat;
+
+	while (proc->pc < code->size) {
+		if (mode)
+			stat = run_budget(proc, BENCH_BUDGET, &n);
+		else
+			stat = run_switch(proc);
+		ninst += n;
+		if (stat != 0) {
+			fprintf(stderr, "instruction %u failed (%d)\n",
+				proc->pc - 1, stat);
+			exit(1);
+		}
+	}
+	elapsed = now_sec() - start;
+	free_proc(proc);
+	return ninst / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t size = (argc > 1) ? atol(argv[1]) : 10000000;
+	static const char *mode_name[] = { "switch", "run_budget()" };
+	struct code_seg_t *calc, *memory, *loop;
+	int sit, mode;
+
+	init_memphy(&mram, BENCH_RAMSZ, 1);
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+		init_memphy(&mswp[sit], BENCH_SWPSZ, 1);
+
+	/* The paging library dumps every access, keep that out of sight */
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		return 1;
+
+	calc = make_code(size, 0);
+	memory = make_code(size / 1000, 1);
+	loop = make_loop(size / 3);
+	fprintf(stderr, "%-14s %16s %16s %16s\n", "dispatch",
+		"calc inst/s", "memory inst/s", "loop inst/s");
+	for (mode = 0; mode < 2; mode++) {
+		char loop_ips[32] = "-"; /* the switch predates branches */
+
+		if (mode != 0)
+			snprintf(loop_ips, sizeof(loop_ips), "%.0f", ips(loop, mode));
+		fprintf(stderr, "%-14s %16.0f %16.0f %16s\n", mode_name[mode],
+			ips(calc, mode), ips(memory, mode), loop_ips);
+	}
+
+	free_code(calc);
+	free_code(memory);
+	free_code(loop);
+	return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Program loading benchmark
+ *
+ * Builds a large text program, compiles it to a packed image and times
+ * reading both forms, then load()/unload() going through the program
+ * cache.
+ *
+ * Usage: bench_load [instructions] [loads]
+ */
+
+#include "loader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double time_reads(const char *path, long loads)
+{
+	double start = now_sec();
+	uint32_t priority;
+	long i;
+
+	for (i = 0; i < loads; i++) {
+		struct code_seg_t *code = load_code(path, &priority);
+
+		if (code == NULL)
+			exit(1);
+		free_code(code);
+	}
+	return now_sec() - start;
+}
+
+static double time_loads(const char *path, long loads)
+{
+	double start = now_sec();
+	long i;
+
+	for (i = 0; i < loads; i++) {
+		struct pcb_t *proc = load(path);
+
+		if (proc == NULL)
+			exit(1);
+		unload(proc);
+	}
+	return now_sec() - start;
+}
+
+int main(int argc, char *argv[])
+{
+	long ninst = (argc > 1) ? atol(argv[1]) : 100000;
+	long loads = (argc > 2) ? atol(argv[2]) : 100;
+	char text[] = "/tmp/bench_loadXXXXXX";
+	char image[sizeof(text) + 4];
+	struct code_seg_t *code;
+	uint32_t priority;
+	double ttext, timg, tcache;
+	FILE *file;
+	long i;
+	int fd;
+
+	if ((fd = mkstemp(text)) < 0 || (file = fdopen(fd, "w")) == NULL)
+		return 1;
+	fprintf(file, "1 %ld\n", ninst);
+	for (i = 0; i < ninst; i++) {
+		switch (i % 4) {
+		case 0: fprintf(file, "alloc 300 %ld\n", i % 10); break;
+		case 1: fprintf(file, "write 100 %ld 20\n", i % 10); break;
+		case 2: fprintf(file, "read %ld 20 0\n", i % 10); break;
+		default: fprintf(file, "calc\n");
+		}
+	}
+	fclose(file);
+
+	snprintf(image, sizeof(image), "%s.img", text);
+	code = load_code(text, &priority);
+	if (code == NULL || save_code(image, priority, code) != 0)
+		return 1;
+	free_code(code);
+
+	ttext = time_reads(text, loads);
+	timg = time_reads(image, loads);
+	tcache = time_loads(text, loads);
+	printf("%ld loads of %ld instructions\n", loads, ninst);
+	printf("text  : %9.3f ms/load\n", ttext * 1e3 / loads);
+	printf("image : %9.3f ms/load (%.0fx)\n", timg * 1e3 / loads, ttext / timg);
+	printf("cached: %9.3f ms/load (%.0fx)\n", tcache * 1e3 / loads, ttext / tcache);
+	flush_code_cache();
+
+	unlink(text);
+	unlink(image);
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Process lifetime leak benchmark
+ *
+ * Loads, runs and tears down the same program over and over against one
+ * MEMRAM/MEMSWP pair and samples the heap in use, the resident set size
+ * and the number of free frames along the way. With a complete exit path
+ * all three stay flat.
+ *
+ * Usage: bench_teardown [lifetimes] [program]
+ */
+
+#include "cpu.h"
+#include "loader.h"
+#include "mm.h"
+#include "libmem.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_RAMSZ     4096
+#define BENCH_SWPSZ     (1 << 16)
+#define BENCH_SAMPLES   10
+
+static long rss_kib(void)
+{
+	long pages = 0, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (f == NULL)
+		return -1;
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+		resident = -1;
+	fclose(f);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int count_free_fp(struct memphy_struct *mp)
+{
+	int n = 0;
+	struct framephy_struct *fp;
+
+	for (fp = mp->free_fp_list; fp != NULL; fp = fp->fp_next)
+		n++;
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	long lifetimes = (argc > 1) ? atol(argv[1]) : 100000;
+	const char *prog = (argc > 2) ? argv[2] : "input/proc/p0s";
+	struct memphy_struct mram, mswp[PAGING_MAX_MMSWP];
+	size_t heap0 = 0, heap;
+	long rss0 = 0, rss, i;
+	int sit, ramfree0;
+
+	init_memphy(&mram, BENCH_RAMSZ, 1);
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+		init_memphy(&mswp[sit], BENCH_SWPSZ, 1);
+	ramfree0 = count_free_fp(&mram);
+
+	/* Keep the paging library dumps out of the measurement */
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		return 1;
+
+	fprintf(stderr, "%10s %12s %10s %10s\n", "lifetimes", "heap(B)", "rss(KiB)", "freefp");
+	for (i = 1; i <= lifetimes; i++) {
+		struct pcb_t *proc = load(prog);
+
+		if (proc == NULL)
+			return 1;
+
+		proc->mm = malloc(sizeof(struct mm_struct));
+		init_mm(proc->mm, proc);
+		proc->mram = &mram;
+		proc->mswp = (struct memphy_struct **)&mswp;
+		proc->active_mswp = &mswp[0];
+
+		while (proc->pc < proc->code->size)
+			run(proc);
+		unload(proc);
+
+		if (i == 1 || i % (lifetimes / BENCH_SAMPLES ? lifetimes / BENCH_SAMPLES : 1) == 0) {
+			heap = mallinfo2().uordblks;
+			rss = rss_kib();
+			if (i == 1) {
+				heap0 = heap;
+				rss0 = rss;
+			}
+			fprintf(stderr, "%10ld %12zu %10ld %10d\n",
+				i, heap, rss, count_free_fp(&mram));
+		}
+	}
+
+	mm_thread_exit();
+	flush_code_cache();
+	heap = mallinfo2().uordblks;
+	fprintf(stderr, "heap growth %ld B, rss growth %ld KiB, frames %s\n",
+		(long)heap - (long)heap0, rss_kib() - rss0,
+		count_free_fp(&mram) == ramfree0 ? "all returned" : "LEAKED");
+	return count_free_fp(&mram) == ramfree0 ? 0 : 1;
+}
@@ -4,6 +4,7 @@
 /* Define structs and routine could be used by every source files */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
 
 #ifndef OSCFG_H
@@ -14,6 +15,8 @@
 #include "os-mm.h"
 #endif
 
+#include "rbtree.h"
+
 #define ADDRESS_SIZE 20
 #define OFFSET_LEN 10
 #define FIRST_LV_LEN 5
@@ -21,6 +24,8 @@
 #define SEGMENT_LEN FIRST_LV_LEN
 #define PAGE_LEN SECOND_LV_LEN
 
+#define NR_REGS 10
+
 #define NUM_PAGES (1 << (ADDRESS_SIZE - OFFSET_LEN))
 #define PAGE_SIZE (1 << OFFSET_LEN)
 
@@ -32,6 +37,16 @@ enum ins_opcode_t
 	READ,  // Write data to a byte on memory
 	WRITE, // Read data from a byte on memory
 	SYSCALL,
+	/* Control flow, targets are instruction indexes */
+	JMP,   // jmp [target]
+	JZ,    // jz [reg] [target], branch if the register is 0
+	JNZ,   // jnz [reg] [target], branch if the register is not 0
+	LOOP,  // loop [reg] [target], decrement, branch while not 0
+	SET,   // set [reg] [value], load a register
+	/* Block memory access, from offset 0 of the regions */
+	COPY,  // copy [src region] [dst region] [len]
+	FILL,  // fill [region] [value] [len]
+	LOAD,  // load [region] [offset] [reg], read a byte into a register
 };
 
 /* instructions executed by the CPU */
@@ -44,10 +59,28 @@ struct inst_t
 	uint32_t arg_3;
 };
 
+struct pcb_t;
+struct code_seg_t;
+struct sc_stat;
+struct sc_ring;
+
+/* Handler executing one opcode */
+typedef int (*ins_handler_t)(struct pcb_t *proc, const struct inst_t *ins);
+
+/* Pre-decoded instruction */
+struct op_t
+{
+	ins_handler_t handler;
+};
+
 struct code_seg_t
 {
 	struct inst_t *text;
+	struct op_t *ops; // Decoded form of each instruction of text
 	uint32_t size;
+	uint32_t refcnt; // PCBs running this code plus the program cache
+	void *img;	 // Mapped program image holding text, NULL if heap text
+	size_t img_len;
 };
 
 struct trans_table_t
@@ -73,23 +106,44 @@ struct page_table_t
 	int size; // Number of row in the first layer
 };
 
+enum proc_state
+{
+	PROC_READY,	 // Waiting in a ready queue
+	PROC_RUNNING,	 // Dispatched on a CPU
+	PROC_BLOCKED,	 // Out of the ready queues until woken up
+	PROC_TERMINATED, // Left the scheduler, about to be unloaded
+};
+
+/* Scheduling timeline of a process, in time slots */
+struct proc_stat
+{
+	uint64_t arrival;     // Admitted by the loader, or forked
+	uint64_t first_run;   // First dispatch, PROC_STAT_NONE until then
+	uint64_t ready_since; // Last entry in a ready queue
+	uint64_t finish;
+	uint64_t wait;	      // Total time in the ready queues
+	uint64_t run;	      // Slots spent on a CPU
+};
+
+#define PROC_STAT_NONE ((uint64_t)-1)
+
 /* PCB, describe information about a process */
 struct pcb_t
 {
 	uint32_t pid;		 // PID
 	uint32_t priority;	 // Default priority, this legacy process based (FIXED)
-	char path[100];
+	const char *path;	 // Program path, interned and shared
 	struct code_seg_t *code; // Code segment
-	addr_t regs[10];	 // Registers, store address of allocated regions
+	addr_t regs[NR_REGS];	 // Registers, store address of allocated regions
 	uint32_t pc;		 // Program pointer, point to the next instruction
 	struct queue_t *ready_queue;
 	struct queue_t *running_list;
 #ifdef MLQ_SCHED
 	struct queue_t *mlq_ready_queue;
-	// Priority on execution (if supported), on-fly aka. changeable
-	// and this vale overwrites the default priority when it existed
-	uint32_t prio;
 #endif
+	// Priority on execution, from the config file under MLQ_SCHED and
+	// the default priority otherwise, what every policy goes by
+	uint32_t prio;
 #ifdef MM_PAGING
 	struct mm_struct *mm;
 	struct memphy_struct *mram;
@@ -99,6 +153,23 @@ struct pcb_t
 #endif
 	struct page_table_t *page_table; // Page table
 	uint32_t bp;			 // Break pointer
+	enum proc_state state;
+	int killed;			   // Set by kill, reaped by the CPU running it
+	struct sc_stat *sc_stats; // Syscall counters, allocated on first call
+	struct sc_ring *sc_ring;  // Queued memmap ops, allocated on first use
+	int on_cpu;		  // Dispatched, until parked or put back
+	uint64_t wake_time;	  // Time slot ending a sleep
+	int wait_key;		  // Physical address waited on by futex_wait
+	struct proc_stat stat;
+	uint64_t vruntime;	  // Virtual time of the stride and fair policies
+	struct rb_node run_node;  // Link in the fair policy timeline
+	int mlfq_level;		  // Current level of the feedback policy
+	int mlfq_used;		  // Slots run at that level
+	uint64_t mlfq_since;	  // Queued at that level since
+	unsigned int mlfq_epoch;  // Boosts done when it was last queued
+	struct pcb_t *wait_next;  // Next process in the same wait list
+	struct pcb_t **sleep_bucket; // Sleep wheel list it is on, or NULL
+	struct pcb_t *name_prev, *name_next; // Process table, same program name
 };
 
 #endif
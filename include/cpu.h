@@ -9,5 +9,15 @@
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
+/* Execute up to budget instructions, every one through its handler.
+ * Stop early on a failed instruction, at the end of the code, or once
+ * the process blocks or yields. done receives the number executed,
+ * the result is the one of the last instruction. */
+int run_budget(struct pcb_t * proc, uint32_t budget, uint32_t * done);
+
+/* Resolve the handler of every instruction of code, once at load time.
+ * Fails on an unknown opcode, a bad register or a branch out of code. */
+int decode_code(struct code_seg_t * code);
+
 #endif
 
@@ -0,0 +1,38 @@
+#ifndef DEV_H
+#define DEV_H
+
+#include "common.h"
+
+/* Simulated I/O devices. Each one serves a FIFO of requests, one at a
+ * time, ticking with the timer like a CPU. A request takes
+ * [latency] + [length / bytes per slot] slots, latency drawn uniformly
+ * between the configured bounds. The requesting process is blocked
+ * until completion. */
+
+#define DEV_MAX 8
+#define DEV_STORE_SZ 1024 /* backing store of a device, in bytes */
+
+/* Config directive "device [name] [latency min] [latency max] [bytes per slot]",
+ * devices are numbered in config order */
+int dev_config(const char * args);
+
+/* Attach the devices to the timer, before start_timer(). Without any
+ * device in the config there is none, devread/devwrite then fail */
+void dev_init(void);
+void dev_start(void);
+/* Once the CPUs are gone, the devices leave the timer at the next slot */
+void dev_shutdown(void);
+void dev_stop(void);
+
+/* Queue a transfer between region rgid of proc and device dev, then
+ * block proc until it completes */
+int dev_submit(struct pcb_t * proc, int dev, int write, uint32_t rgid,
+		uint32_t len);
+/* Drop the request proc waits on, 1 if there was one. The caller
+ * unblocks proc */
+int dev_cancel(struct pcb_t * proc);
+
+/* Nothing without a device in the config */
+void dev_stat_dump(void);
+
+#endif
@@ -15,12 +15,26 @@
 #define SYSMEM_SWP_OP 3
 #define SYSMEM_IO_READ 4
 #define SYSMEM_IO_WRITE 5
+#define SYSMEM_SWPIN_OP 6
+#define SYSMEM_COW_OP 7
+#define SYSMEM_IO_COPY 8
+#define SYSMEM_IO_FILL 9
+#define SYSMEM_BATCH_OP 10 /* run the queued ops of the caller ring */
+#define SYSMEM_UNMAP_OP 11 /* detach a shared region */
 
 extern struct vm_area_struct* get_vma_by_num(struct mm_struct* mm, int vmaid);
 int inc_vma_limit(struct pcb_t*, int, int);
 int __mm_swap_page(struct pcb_t*, int, int);
-int liballoc(struct pcb_t*, uint32_t, uint32_t);
+int __mm_swap_in_page(struct pcb_t*, int, int);
+int __mm_cow_page(struct pcb_t*, int, int);
+int __mm_shm_map(struct pcb_t*, int, int);
+int __mm_shm_unmap(struct pcb_t*, int);
+int liballoc(struct pcb_t*, uint32_t, uint32_t, uint32_t);
 int libfree(struct pcb_t*, uint32_t);
 int libread(struct pcb_t*, uint32_t, uint32_t, uint32_t*);
 int libwrite(struct pcb_t*, BYTE, uint32_t, uint32_t);
+int libcopy(struct pcb_t*, uint32_t, uint32_t, uint32_t);
+int libfill(struct pcb_t*, uint32_t, BYTE, uint32_t);
+int free_pcb_memph(struct pcb_t*);
+int free_pcb_mm(struct pcb_t*);
 
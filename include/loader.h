@@ -3,7 +3,39 @@
 
 #include "common.h"
 
+/* Packed program image, a header followed by the struct inst_t array.
+ * It is produced by tools/progc from a text program and mapped as is. */
+#define PROG_MAGIC 0x474f5250 /* "PROG" */
+
+struct prog_hdr {
+	uint32_t magic;
+	uint32_t inst_sz;  /* sizeof(struct inst_t) of the writer */
+	uint32_t priority;
+	uint32_t size;     /* number of instructions */
+};
+
+/* Load a program, text or image, returns NULL on a bad program */
 struct pcb_t * load(const char * path);
+/* Same without a PID, given by the caller when admitting the process */
+struct pcb_t * load_pcb(const char * path);
+
+struct code_seg_t * load_code(const char * path, uint32_t * priority);
+int save_code(const char * path, uint32_t priority,
+		const struct code_seg_t * code);
+void free_code(struct code_seg_t * code);
+
+/* Shared copy of a path string, valid until flush_code_cache() */
+const char * intern_path(const char * path);
+
+/* load() shares one code segment per program through a cache keyed by
+ * path and modification time. Drop it, and the interned paths, once
+ * nothing will load anymore */
+void flush_code_cache(void);
+
+uint32_t alloc_pid(void);
+
+/* Release a finished process with its memory and code */
+void unload(struct pcb_t * proc);
 
 #endif
 
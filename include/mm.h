@@ -26,6 +26,31 @@
 #define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
 #define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
 
+/* PTE BIT SWAPPED */
+#define PAGING_PAGE_SWAPPED(pte) (pte&PAGING_PTE_SWAPPED_MASK)
+
+/* PTE software bits, only meaningful for an online (non swapped) page
+ * since SWPOFF overlaps them once the page goes to MEMSWP
+ */
+#define PAGING_PTE_RDAHEAD_MASK PAGING_PTE_EMPTY01_MASK /* brought in by readahead, not yet used */
+#define PAGING_PTE_COW_MASK     PAGING_PTE_EMPTY02_MASK /* write protected, frame shared after fork */
+/* Above SWPOFF, so a swapped out shared page is still known as one */
+#define PAGING_PTE_SHM_MASK     BIT(PAGING_PTE_USRNUM_HIBIT) /* page of a shared region */
+
+/* Standard vm areas of a process */
+#define PAGING_VMA_HEAP   0 /* sbrk heap, grows up from 0 */
+#define PAGING_VMA_STACK  1 /* grows down from the top of the address space */
+#define PAGING_VMA_MMAP   2 /* mapped and shared regions, grows up from the middle */
+#define PAGING_MMAP_BASE  (BIT(PAGING_CPU_BUS_WIDTH) / 2)
+#define PAGING_STACK_TOP  BIT(PAGING_CPU_BUS_WIDTH)
+
+/* VMA flags */
+#define VM_GROWSDOWN BIT(0)
+
+/* Swap-in readahead window (in pages) */
+#define PAGING_RA_INIT_WIN 2
+#define PAGING_RA_MAX_WIN  16
+
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
 #define PAGING_PTE_USRNUM_HIBIT 27
@@ -98,9 +123,10 @@
 #define INCLUDE(x1, x2, y1, y2)  (((x1) <= (y1) && (y2) <= (x2)) ? 1 : 0)
 #define OVERLAP(x1, x2, y1, y2)  (((x1) <= (y2) && (y1) <= (x2)) ? 1 : 0)
 /* VM region prototypes */
-struct vm_rg_struct* init_vm_rg(int rg_start, int rg_endi);
+struct vm_rg_struct* init_vm_rg(struct mm_struct* mm, int rg_start, int rg_end);
 int enlist_vm_rg_node(struct vm_rg_struct** rglist, struct vm_rg_struct* rgnode);
-int enlist_pgn_node(struct pgn_t** pgnlist, int pgn);
+int enlist_pgn_node(struct mm_struct* mm, struct pgn_t** pgnlist, int pgn);
+void mm_thread_exit(void);
 int vmap_page_range(struct pcb_t* caller, int addr, int pgnum,
                     struct framephy_struct* frames, struct vm_rg_struct* ret_rg);
 int vm_map_ram(struct pcb_t* caller, int astart, int send, int mapstart, int incpgnum, struct vm_rg_struct* ret_rg);
@@ -120,6 +146,12 @@ int __alloc(struct pcb_t* caller, int vmaid, int rgid, int size, int* alloc_addr
 int __free(struct pcb_t* caller, int vmaid, int rgid);
 int __read(struct pcb_t* caller, int vmaid, int rgid, int offset, BYTE* data);
 int __write(struct pcb_t* caller, int vmaid, int rgid, int offset, BYTE value);
+int __copy(struct pcb_t* caller, int srcrg, int srcoff, int dstrg, int dstoff, int len);
+int __fill(struct pcb_t* caller, int rgid, int offset, BYTE value, int len);
+int __rg_size(struct pcb_t* caller, int rgid);
+int __rg_paddr(struct pcb_t* caller, int rgid, int offset);
+int __read_block(struct pcb_t* caller, int rgid, int offset, BYTE* buf, int len);
+int __write_block(struct pcb_t* caller, int rgid, int offset, const BYTE* buf, int len);
 int init_mm(struct mm_struct* mm, struct pcb_t* caller);
 
 /* VM prototypes */
@@ -137,17 +169,29 @@ int pgwrite(
 	uint32_t offset);
 /* Local VM prototypes */
 struct vm_rg_struct* get_symrg_byid(struct mm_struct* mm, int rgid);
+struct vm_rg_struct* alloc_symrg_byid(struct mm_struct* mm, int rgid);
 int validate_overlap_vm_area(struct pcb_t* caller, int vmaid, int vmastart, int vmaend);
 int get_free_vmrg_area(struct pcb_t* caller, int vmaid, int size, struct vm_rg_struct* newrg);
 int inc_vma_limit(struct pcb_t* caller, int vmaid, int inc_sz);
 int find_victim_page(struct mm_struct* mm, int* pgn);
+int pg_reclaim_frame(struct pcb_t* caller, int* fpn);
+int __mm_fork(struct pcb_t* parent, struct pcb_t* child);
 struct vm_area_struct* get_vma_by_num(struct mm_struct* mm, int vmaid);
+struct vm_area_struct* get_vma_by_addr(struct mm_struct* mm, unsigned long addr);
+int insert_vm_area(struct mm_struct* mm, struct vm_area_struct* vma);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct* mp, int* fpn);
 int MEMPHY_put_freefp(struct memphy_struct* mp, int fpn);
+int MEMPHY_ref_fp(struct memphy_struct* mp, int fpn);
+int MEMPHY_unref_fp(struct memphy_struct* mp, int fpn);
+int MEMPHY_fp_refcnt(struct memphy_struct* mp, int fpn);
 int MEMPHY_read(struct memphy_struct* mp, int addr, BYTE* value);
 int MEMPHY_write(struct memphy_struct* mp, int addr, BYTE data);
+int MEMPHY_copy(struct memphy_struct* mp, int src, int dst, int len);
+int MEMPHY_read_block(struct memphy_struct* mp, int addr, BYTE* buf, int len);
+int MEMPHY_write_block(struct memphy_struct* mp, int addr, const BYTE* buf, int len);
+int MEMPHY_fill(struct memphy_struct* mp, int addr, BYTE value, int len);
 int MEMPHY_dump(struct memphy_struct* mp);
 int init_memphy(struct memphy_struct* mp, int max_size, int randomflg);
 
@@ -159,4 +203,5 @@ int print_list_vma(struct vm_area_struct* rg);
 
 int print_list_pgn(struct pgn_t* ip);
 int print_pgtbl(struct pcb_t* ip, uint32_t start, uint32_t end);
+int print_ra_stat(struct pcb_t* ip);
 #endif
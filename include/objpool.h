@@ -0,0 +1,31 @@
+#ifndef OBJPOOL_H
+#define OBJPOOL_H
+
+#include <stddef.h>
+
+#define OBJPOOL_CACHELINE 64   /* chunks and objects never straddle a line */
+#define OBJPOOL_CHUNKSZ   4096 /* bytes carved out of malloc at a time */
+
+/*
+ * Fixed size object pool, an arena of cache aligned chunks plus a free
+ * list threaded through the released objects. A pool has no lock, it is
+ * owned by one user at a time (a process mm, a CPU thread or a device
+ * already serialised by its own lock) and is released in one go.
+ */
+struct objpool {
+   size_t objsz;    /* requested object size */
+   size_t stride;   /* objsz rounded so objects stay inside a line */
+   void *chunks;    /* arena chunks, linked through their first word */
+   void *free_list; /* released objects, linked through their first word */
+   void *bump;      /* next never used object of the newest chunk */
+   void *bump_end;
+};
+
+#define OBJPOOL_INITIALIZER(type) { sizeof(type), 0, NULL, NULL, NULL, NULL }
+
+void objpool_init(struct objpool *pool, size_t objsz);
+void *objpool_get(struct objpool *pool);
+void objpool_put(struct objpool *pool, void *obj);
+void objpool_release(struct objpool *pool);
+
+#endif
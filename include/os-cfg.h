@@ -4,7 +4,11 @@
 #define MLQ_SCHED 1
 #define MAX_PRIO 140
 
+#define LD_THREADS 2    /* background loaders building PCBs ahead of time */
+#define LD_LOOKAHEAD 16 /* PCBs built but not yet admitted, at most */
+
 #define MM_PAGING
+// #define MM_READAHEAD /* swap-in readahead, or make READAHEAD=1 */
 // #define MM_FIXED_MEMSZ
 #define VMDBG 1
 // #define MMDBG 1
@@ -1,10 +1,14 @@
 #ifndef OSMM_H
 #define OSMM_H
 
+#include "objpool.h"
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
-#define PAGING_MAX_SYMTBL_SZ 30
+#define PAGING_MAX_SYMTBL_SZ 8192 /* region IDs are below this bound */
+#define PAGING_SYMTBL_PGSZ 32 /* regions per symbol table page */
+#define SHM_MAX_SEGS 32 /* max number of named shared regions */
+#define PAGING_MAX_VMA 8 /* max number of vm areas per process */
 
 typedef char BYTE;
 typedef uint32_t addr_t;
@@ -21,6 +25,7 @@ struct pgn_t{
 struct vm_rg_struct {
    unsigned long rg_start;
    unsigned long rg_end;
+   int vmaid;   /* owning vm area of a symbol table region */
 
    struct vm_rg_struct *rg_next;
 };
@@ -34,6 +39,7 @@ struct vm_area_struct {
    unsigned long vm_end;
 
    unsigned long sbrk;
+   unsigned long vm_flags;
 /*
  * Derived field
  * unsigned long vm_limit = vm_end - vm_start
@@ -51,11 +57,32 @@ struct mm_struct {
 
    struct vm_area_struct *mmap;
 
-   /* Currently we support a fixed number of symbol */
-   struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
+   /* Lookup of vm areas by ID and by address (sorted on vm_start) */
+   struct vm_area_struct *vma_byid[PAGING_MAX_VMA];
+   struct vm_area_struct *vma_sorted[PAGING_MAX_VMA];
+   int vma_cnt;
+
+   /* Symbol table, a directory of PAGING_SYMTBL_PGSZ sized pages
+    * allocated on first use of one of their region IDs */
+   struct vm_rg_struct **symrgtbl;
+   int symrgtbl_npg;
 
    /* list of free page */
    struct pgn_t *fifo_pgn;
+
+   /* Node pools of this mm, released in bulk on exit */
+   struct objpool pgn_pool;   /* struct pgn_t */
+   struct objpool rg_pool;    /* struct vm_rg_struct */
+
+   /* Swap-in readahead state */
+   int ra_win;      /* current window size in pages */
+   int ra_lastpgn;  /* last page of the detected stream */
+
+   /* Readahead counters */
+   unsigned long ra_faults;   /* swap-in faults taken */
+   unsigned long ra_issued;   /* pages prefetched */
+   unsigned long ra_hits;     /* prefetched pages used, i.e. faults avoided */
+   unsigned long ra_wasted;   /* prefetched pages evicted before use */
 };
 
 /*
@@ -69,6 +96,31 @@ struct framephy_struct {
    struct mm_struct* owner;
 };
 
+/*
+ * Mapping of a shared region into one process
+ */
+struct shm_map_struct {
+   struct pcb_t *proc;
+   int pgn;     /* first page of the mapping */
+   int rgid;    /* region ID naming it in the process */
+   int whole;   /* mapped at the mmap break, the pages hold nothing else */
+   struct shm_map_struct *next;
+};
+
+/*
+ * Shared anonymous region, published under a key by SYSMEM_MAP_OP.
+ * Each page has one reference per mapping plus one held by the
+ * segment, on its MEMRAM frame or its MEMSWP slot.
+ */
+struct shm_seg_struct {
+   int key;
+   int npages;
+   int rg_off;  /* region start inside its first page */
+   int rg_sz;   /* region size in bytes */
+   uint32_t *ptes;  /* frame or swap slot of each page, PTE encoded */
+   struct shm_map_struct *maps;  /* NULL for a free registry slot */
+};
+
 struct memphy_struct {
    /* Basic field of data and size */
    BYTE *storage;
@@ -81,6 +133,10 @@ struct memphy_struct {
    /* Management structure */
    struct framephy_struct *free_fp_list;
    struct framephy_struct *used_fp_list;
+   struct objpool fp_pool;   /* free list nodes, under the frame lock */
+
+   /* Per frame reference count, frames are shared after fork */
+   int *fp_refcnt;
 };
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef PROCTBL_H
+#define PROCTBL_H
+
+#include "common.h"
+
+/* Table of the live processes indexed by program name, the basename of
+ * their path. Kill marks the processes and cancels their waits, the
+ * scheduler reaps them. */
+
+#define PROCTBL_BUCKETS 256
+
+/* Program name of a path, the part after the last '/' */
+const char * prog_name(const char * path);
+
+/* Enter an admitted process, leave it when it quits the scheduler */
+void proctbl_add(struct pcb_t * proc);
+void proctbl_remove(struct pcb_t * proc);
+
+/* Mark every process running program name as killed, return how many */
+int proctbl_kill(const char * name);
+
+/* Set once the process is marked, read by the CPU running it */
+int proc_killed(struct pcb_t * proc);
+
+/* Release the index once no process is left */
+void proctbl_flush(void);
+
+#endif
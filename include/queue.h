@@ -4,11 +4,12 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 10
-
+/* Ring of PCBs growing on demand, a zeroed queue_t is a valid empty one */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;
+	int head;	// Index of the oldest entry in proc[]
 	int size;
+	int cap;
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
@@ -17,5 +18,18 @@ struct pcb_t * dequeue(struct queue_t * q);
 
 int empty(struct queue_t * q);
 
+/* Oldest entry, left in place, NULL if q is empty */
+struct pcb_t * queue_peek(struct queue_t * q);
+
+/* Take the entry of lowest key, the oldest one among equals */
+struct pcb_t * dequeue_min(struct queue_t * q,
+		uint64_t (*key)(const struct pcb_t *));
+
+/* Take proc out of q wherever it is, 0 if it was there */
+int remove_queue(struct queue_t * q, struct pcb_t * proc);
+
+/* Release the storage of q, left empty */
+void free_queue(struct queue_t * q);
+
 #endif
 
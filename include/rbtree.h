@@ -0,0 +1,46 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+
+/*
+ * Intrusive red-black tree. The node is embedded in the indexed
+ * object, the caller walks down to the insertion point with its own
+ * ordering, links the node there and rebalances with rb_insert().
+ */
+struct rb_node {
+	struct rb_node * parent;
+	struct rb_node * left;
+	struct rb_node * right;
+	int red;
+};
+
+struct rb_root {
+	struct rb_node * node;
+};
+
+#define rb_entry(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Hang node under parent at *link, a NULL child pointer of parent */
+static inline void rb_link(struct rb_node * node, struct rb_node * parent,
+		struct rb_node ** link)
+{
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->red = 1;
+	*link = node;
+}
+
+/* Restore the red-black properties after rb_link() */
+void rb_insert(struct rb_root * root, struct rb_node * node);
+
+void rb_erase(struct rb_root * root, struct rb_node * node);
+
+/* Smallest node, NULL on an empty tree */
+struct rb_node * rb_first(const struct rb_root * root);
+
+/* In order successor, NULL after the last node */
+struct rb_node * rb_next(const struct rb_node * node);
+
+#endif
@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
@@ -9,6 +9,43 @@
 
 #define MAX_PRIO 140
 
+/* Scheduling policy, chosen at run time. Its hooks are called with the
+ * scheduler lock held, get_proc(), put_proc() and add_proc() go through
+ * them. */
+struct sched_policy {
+	const char * name;
+	void (*init)(void);
+	void (*fini)(void);
+	int (*empty)(void);
+	/* Next process to dispatch, NULL if none is ready */
+	struct pcb_t * (*pick_next)(void);
+	/* A process becoming ready: admitted, forked or woken up */
+	void (*enqueue)(struct pcb_t * proc);
+	/* A process put back by its CPU, slice over or yielded */
+	void (*requeue)(struct pcb_t * proc);
+	/* proc ran one time slot, optional */
+	void (*on_tick)(struct pcb_t * proc);
+	/* Time slots granted to proc on dispatch, optional, the config
+	 * time slot otherwise */
+	int (*slice)(struct pcb_t * proc);
+	/* Arguments after the name in the policy directive, optional */
+	int (*config)(const char * args);
+};
+
+extern const struct sched_policy sched_mlq_policy;    /* default */
+extern const struct sched_policy sched_rr_policy;
+extern const struct sched_policy sched_stride_policy;
+extern const struct sched_policy sched_cfs_policy;
+extern const struct sched_policy sched_mlfq_policy;
+
+/* Config directive "policy [name] [args]", before init_scheduler() */
+int sched_select(const char * args);
+const char * sched_policy_name(void);
+
+/* Share of a process for the proportional policies, prio 0 is the
+ * largest */
+#define sched_weight(proc) ((uint64_t)(MAX_PRIO - (proc)->prio))
+
 int queue_empty(void);
 
 void init_scheduler(void);
@@ -23,6 +60,43 @@ void put_proc(struct pcb_t * proc);
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
 
+/* Time slots proc runs before being put back, def if the policy
+ * has no say */
+int sched_slice(struct pcb_t * proc, int def);
+
+/* Account one time slot run by proc */
+void tick_proc(struct pcb_t * proc);
+
+/* Forget a process leaving the system */
+void remove_proc(struct pcb_t * proc);
+
+/* Blocked processes are out of the ready queues but still alive, the
+ * CPUs keep running while there are some. A syscall blocks its caller,
+ * the CPU then parks it, unless it was woken up in between. */
+void block_proc(struct pcb_t * proc);
+void unblock_proc(struct pcb_t * proc);
+/* Return 1 if proc left the CPU, 0 if it was already woken up */
+int park_proc(struct pcb_t * proc);
+int blocked_procs(void);
+/* 1 if the live processes are all blocked, and waiters of them are
+ * every blocked one: none runs, is ready, sleeps or waits elsewhere */
+int all_blocked_on(int waiters);
+/* Reap the futex waiters once nothing else is left to wake them, see
+ * sys_futex.c */
+int futex_reap_deadlocked(void);
+
+/* Timer wheel of sleeping processes, woken at proc->wake_time. One
+ * slot per bucket for the current round, one round per bucket past it */
+#define SLEEP_WHEEL_SZ 64
+
+void sleep_proc(struct pcb_t * proc);
+/* Wake the sleepers due up to time slot now */
+void wake_sleepers(uint64_t now);
+
+/* Pull a killed process out of its futex, sleep or device wait and
+ * back to the ready queues, where a CPU reaps it */
+void cancel_wait(struct pcb_t * proc);
+
 #endif
 
 
@@ -0,0 +1,23 @@
+#ifndef SCHEDSTAT_H
+#define SCHEDSTAT_H
+
+#include "common.h"
+
+/* Scheduling quality report, built from the timeline of every process
+ * leaving the system and the busy slots of every CPU. Printed at exit,
+ * and exported as CSV or JSON when the config asks for it. */
+
+/* Config directive "report [path]", JSON for a .json path, CSV else */
+int schedstat_config(const char * args);
+
+void schedstat_init(int num_cpus);
+
+/* Record a process leaving the scheduler, its stat is final */
+void schedstat_exit(struct pcb_t * proc);
+
+/* Busy slots of a CPU over its lifetime, called when it stops */
+void schedstat_cpu(int id, unsigned long busy);
+
+void schedstat_report(void);
+
+#endif
@@ -8,6 +8,9 @@
  * for the sole purpose of studying while attending the course CO2018.
  */
 
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
 #include "common.h"
 
 struct sc_regs {
@@ -31,10 +34,46 @@ struct sc_regs {
 
 
 /* This is used purely for kernel trace the table of system call */
-//typedef long (*sys_call_ptr_t)(const struct sc_regs *);
+typedef int (*sys_call_ptr_t)(struct pcb_t *, struct sc_regs *);
 extern const char* sys_call_table[];
 extern const int syscall_table_size;
+
+/* Per syscall counters, kept per process and for the whole system */
+struct sc_stat {
+        uint64_t calls;
+        uint64_t errors;  // negative returns
+        uint64_t ns;      // host time spent in the handler, see below
+};
+
+/* Submission ring of a process. The paging library queues SYSMEM ops
+ * into it, one SYSMEM_BATCH_OP memmap call runs them in order and
+ * leaves each result in the flags of its entry */
+#define SC_RING_SZ 32
+
+struct sc_ring {
+        int count;        // queued entries
+        struct sc_regs sqe[SC_RING_SZ];
+};
+
+/* Counters of proc, or of the whole system for NULL, all zero for a
+ * process yet to make a syscall. Slots are the indexes of
+ * sys_call_table[], nr receives the syscall number */
+const struct sc_stat *syscall_stat(struct pcb_t *, int, uint32_t *);
+void syscall_stat_dump(void);
+/* Host times vary from run to run, they are only measured and printed
+ * when SYSCALL_TIMES is set in the environment */
+int syscall_host_times(void);
 int syscall(struct pcb_t*, uint32_t, struct sc_regs*);
 int libsyscall(struct pcb_t*, uint32_t, uint32_t, uint32_t, uint32_t);
 int __sys_ni_syscall(struct pcb_t*, struct sc_regs*);
 
+/* User memory access for syscalls. User buffers are regions of the
+ * caller, named by region ID, accessed from a byte offset. */
+int copy_from_user(struct pcb_t*, void*, uint32_t, uint32_t, size_t);
+int copy_to_user(struct pcb_t*, uint32_t, uint32_t, const void*, size_t);
+int strncpy_from_user(struct pcb_t*, char*, uint32_t, size_t);
+
+/* Take a process off the futex wait lists, 1 if it was on one */
+int futex_cancel(struct pcb_t*);
+
+#endif
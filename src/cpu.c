@@ -5,6 +5,8 @@
 #include "syscall.h"
 #include "libmem.h"
 
+#include <stdlib.h>
+
 int calc(struct pcb_t *proc)
 {
 	return ((unsigned long)proc & 0UL);
@@ -58,55 +60,222 @@ int write(
 	return write_mem(proc->regs[destination] + offset, proc, data);
 }
 
-int run(struct pcb_t *proc)
+/* Instruction handlers, picked once per instruction by decode_code() */
+static int op_calc(struct pcb_t *proc, const struct inst_t *ins)
 {
-	/* Check if Program Counter point to the proper instruction */
-	if (proc->pc >= proc->code->size)
-	{
-		return 1;
-	}
+	return calc(proc);
+}
 
-	struct inst_t ins = proc->code->text[proc->pc];
-	proc->pc++;
-	int stat = 1;
-switch (ins.opcode)
-	{
-	case CALC:
-		stat = calc(proc);
-		break;
-	case ALLOC:
+static int op_alloc(struct pcb_t *proc, const struct inst_t *ins)
+{
 #ifdef MM_PAGING
-		stat = liballoc(proc, ins.arg_0, ins.arg_1);
+	return liballoc(proc, ins->arg_0, ins->arg_1, ins->arg_2);
 #else
-		stat = alloc(proc, ins.arg_0, ins.arg_1);
+	return alloc(proc, ins->arg_0, ins->arg_1);
 #endif
-		break;
-	case FREE:
+}
+
+static int op_free(struct pcb_t *proc, const struct inst_t *ins)
+{
 #ifdef MM_PAGING
-		stat = libfree(proc, ins.arg_0);
+	return libfree(proc, ins->arg_0);
 #else
-		stat = free_data(proc, ins.arg_0);
+	return free_data(proc, ins->arg_0);
 #endif
-		break;
-	case READ:
+}
+
+static int op_read(struct pcb_t *proc, const struct inst_t *ins)
+{
 #ifdef MM_PAGING
-		stat = libread(proc, ins.arg_0, ins.arg_1, &ins.arg_2);
+	uint32_t data;
+
+	return libread(proc, ins->arg_0, ins->arg_1, &data);
 #else
-		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	return read(proc, ins->arg_0, ins->arg_1, ins->arg_2);
 #endif
-		break;
-	case WRITE:
+}
+
+/* Like read, but the byte lands in a register the branches can test */
+static int op_load(struct pcb_t *proc, const struct inst_t *ins)
+{
 #ifdef MM_PAGING
-		stat = libwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	uint32_t data;
+	int stat = libread(proc, ins->arg_0, ins->arg_1, &data);
+
+	if (stat == 0)
+		proc->regs[ins->arg_2] = data;
+	return stat;
+#else
+	return read(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+#endif
+}
+
+static int op_write(struct pcb_t *proc, const struct inst_t *ins)
+{
+#ifdef MM_PAGING
+	return libwrite(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+#else
+	return write(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+#endif
+}
+
+static int op_copy(struct pcb_t *proc, const struct inst_t *ins)
+{
+#ifdef MM_PAGING
+	return libcopy(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+#else
+	return 1; /* needs the paging library */
+#endif
+}
+
+static int op_fill(struct pcb_t *proc, const struct inst_t *ins)
+{
+#ifdef MM_PAGING
+	return libfill(proc, ins->arg_0, ins->arg_1, ins->arg_2);
 #else
-		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	return 1;
 #endif
+}
+
+static int op_syscall(struct pcb_t *proc, const struct inst_t *ins)
+{
+	return libsyscall(proc, ins->arg_0, ins->arg_1, ins->arg_2, ins->arg_3);
+}
+
+/* Registers and targets of the branches are checked by decode_code() */
+static int op_jmp(struct pcb_t *proc, const struct inst_t *ins)
+{
+	proc->pc = ins->arg_0;
+	return 0;
+}
+
+static int op_jz(struct pcb_t *proc, const struct inst_t *ins)
+{
+	if (proc->regs[ins->arg_0] == 0)
+		proc->pc = ins->arg_1;
+	return 0;
+}
+
+static int op_jnz(struct pcb_t *proc, const struct inst_t *ins)
+{
+	if (proc->regs[ins->arg_0] != 0)
+		proc->pc = ins->arg_1;
+	return 0;
+}
+
+static int op_loop(struct pcb_t *proc, const struct inst_t *ins)
+{
+	/* A counter found at 0 falls through instead of wrapping */
+	if (proc->regs[ins->arg_0] != 0 && --proc->regs[ins->arg_0] != 0)
+		proc->pc = ins->arg_1;
+	return 0;
+}
+
+static int op_set(struct pcb_t *proc, const struct inst_t *ins)
+{
+	proc->regs[ins->arg_0] = ins->arg_1;
+	return 0;
+}
+
+static const ins_handler_t ins_handlers[] = {
+	[CALC] = op_calc,
+	[ALLOC] = op_alloc,
+	[FREE] = op_free,
+	[READ] = op_read,
+	[WRITE] = op_write,
+	[SYSCALL] = op_syscall,
+	[JMP] = op_jmp,
+	[JZ] = op_jz,
+	[JNZ] = op_jnz,
+	[LOOP] = op_loop,
+	[SET] = op_set,
+	[COPY] = op_copy,
+	[FILL] = op_fill,
+	[LOAD] = op_load,
+};
+
+/* Operands an opcode's handler trusts, -1 when it has no such operand */
+static int check_operands(const struct code_seg_t *code, const struct inst_t *ins)
+{
+	uint32_t reg, target;
+
+	switch (ins->opcode)
+	{
+	case JMP:
+		reg = 0;
+		target = ins->arg_0;
+		break;
+	case JZ:
+	case JNZ:
+	case LOOP:
+		reg = ins->arg_0;
+		target = ins->arg_1;
 		break;
-	case SYSCALL:
-		stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
+	case SET:
+		reg = ins->arg_0;
+		target = 0;
+		break;
+	case LOAD:
+		reg = ins->arg_2;
+		target = 0;
 		break;
 	default:
-		stat = 1;
+		return 0;
+	}
+	return (reg < NR_REGS && target < code->size) ? 0 : -1;
+}
+
+#define NR_HANDLERS (sizeof(ins_handlers) / sizeof(ins_handlers[0]))
+
+int decode_code(struct code_seg_t *code)
+{
+	uint32_t i;
+
+	code->ops = malloc(code->size * sizeof(struct op_t));
+	if (code->ops == NULL && code->size != 0)
+		return -1;
+
+	for (i = 0; i < code->size; i++)
+	{
+		unsigned int opcode = code->text[i].opcode;
+
+		if (opcode >= NR_HANDLERS || ins_handlers[opcode] == NULL ||
+		    check_operands(code, &code->text[i]) != 0)
+		{
+			printf("Invalid instruction %u (opcode %u)\n", i, opcode);
+			free(code->ops);
+			code->ops = NULL;
+			return -1;
+		}
+		code->ops[i].handler = ins_handlers[opcode];
+	}
+	return 0;
+}
+
+int run(struct pcb_t *proc)
+{
+	/* Check if Program Counter point to the proper instruction */
+	if (proc->pc >= proc->code->size)
+	{
+		return 1;
+	}
+
+	uint32_t pc = proc->pc++;
+	return proc->code->ops[pc].handler(proc, &proc->code->text[pc]);
+}
+
+int run_budget(struct pcb_t *proc, uint32_t budget, uint32_t *done)
+{
+	/* Nothing left to run is the end of the code, as for run() */
+	int stat = proc->pc >= proc->code->size;
+
+	for (*done = 0; *done < budget && proc->pc < proc->code->size;)
+	{
+		stat = run(proc);
+		(*done)++;
+		/* Blocked or yielded, the CPU has to pick the next process */
+		if (stat != 0 || proc->state != PROC_RUNNING)
+			break;
 	}
 	return stat;
 }
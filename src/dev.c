@@ -0,0 +1,252 @@
+/*
+ * Simulated I/O devices with asynchronous completion.
+ */
+
+#include "dev.h"
+#include "timer.h"
+#include "sched.h"
+#include "syscall.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct dev_req
+{
+	struct pcb_t *proc;
+	uint32_t slots;	    /* service time left */
+	uint32_t len;
+	uint64_t submitted; /* time slot */
+	struct dev_req *next;
+};
+
+struct dev_t
+{
+	char name[32];
+	uint32_t lat_min, lat_max, rate;
+	unsigned int seed;
+	BYTE store[DEV_STORE_SZ];
+
+	pthread_mutex_t lock;
+	struct dev_req *head, *tail; /* head is in service */
+	int qlen;
+
+	struct timer_id_t *timer_id;
+	pthread_t thread;
+
+	/* Counters */
+	unsigned long requests;
+	unsigned long bytes;
+	unsigned long busy_slots;
+	unsigned long wait_slots; /* submit to completion, summed */
+	int max_qlen;
+};
+
+static struct dev_t devs[DEV_MAX];
+static int num_devs;
+static int dev_stopping;
+static uint64_t dev_end; /* slot the CPUs stopped in */
+
+int dev_config(const char *args)
+{
+	struct dev_t *dev;
+
+	if (num_devs == DEV_MAX)
+		return -1;
+	dev = &devs[num_devs];
+	if (sscanf(args, "%31s %u %u %u", dev->name, &dev->lat_min,
+		   &dev->lat_max, &dev->rate) != 4 ||
+	    dev->lat_max < dev->lat_min || dev->rate == 0)
+		return -1;
+	dev->seed = num_devs + 1;
+	num_devs++;
+	return 0;
+}
+
+void dev_init(void)
+{
+	int i;
+
+	for (i = 0; i < num_devs; i++)
+	{
+		pthread_mutex_init(&devs[i].lock, NULL);
+		devs[i].timer_id = attach_event();
+	}
+}
+
+/* Service time of a new request, dev->lock must be held */
+static uint32_t dev_service_time(struct dev_t *dev, uint32_t len)
+{
+	uint32_t lat = dev->lat_min;
+
+	if (dev->lat_max > dev->lat_min)
+		lat += rand_r(&dev->seed) % (dev->lat_max - dev->lat_min + 1);
+	return lat + (len + dev->rate - 1) / dev->rate;
+}
+
+static void *dev_routine(void *args)
+{
+	struct dev_t *dev = (struct dev_t *)args;
+	struct dev_req *req;
+
+	while (!__atomic_load_n(&dev_stopping, __ATOMIC_ACQUIRE))
+	{
+		req = NULL;
+		pthread_mutex_lock(&dev->lock);
+		if (dev->head != NULL)
+		{
+			dev->busy_slots++;
+			if (--dev->head->slots == 0)
+			{
+				req = dev->head;
+				dev->head = req->next;
+				if (dev->head == NULL)
+					dev->tail = NULL;
+				dev->qlen--;
+				dev->wait_slots += current_time() + 1 - req->submitted;
+			}
+		}
+		pthread_mutex_unlock(&dev->lock);
+
+		if (req != NULL)
+		{
+			/* Completion interrupt, back to the ready queues */
+			printf("\tDEV %s: Completed I/O of process %2d\n",
+			       dev->name, req->proc->pid);
+			unblock_proc(req->proc);
+			free(req);
+		}
+		next_slot(dev->timer_id);
+	}
+	detach_event(dev->timer_id);
+	pthread_exit(NULL);
+}
+
+void dev_start(void)
+{
+	int i;
+
+	for (i = 0; i < num_devs; i++)
+		pthread_create(&devs[i].thread, NULL, dev_routine, &devs[i]);
+}
+
+void dev_shutdown(void)
+{
+	/* The first call, from the last CPU out, ends the measured run */
+	if (__atomic_exchange_n(&dev_stopping, 1, __ATOMIC_ACQ_REL) == 0)
+		dev_end = current_time();
+}
+
+void dev_stop(void)
+{
+	int i;
+
+	dev_shutdown();
+	for (i = 0; i < num_devs; i++)
+	{
+		pthread_join(devs[i].thread, NULL);
+		pthread_mutex_destroy(&devs[i].lock);
+	}
+}
+
+int dev_submit(struct pcb_t *proc, int devid, int write, uint32_t rgid,
+	       uint32_t len)
+{
+	struct dev_t *dev;
+	struct dev_req *req;
+	int ret;
+
+	if (devid < 0 || devid >= num_devs || len == 0 || len > DEV_STORE_SZ)
+		return -1;
+	dev = &devs[devid];
+
+	/* Data moves now, in the process thread, only the latency is
+	 * simulated: the process cannot look before it completes */
+	pthread_mutex_lock(&dev->lock);
+	if (write)
+		ret = copy_from_user(proc, dev->store, rgid, 0, len);
+	else
+		ret = copy_to_user(proc, rgid, 0, dev->store, len);
+	pthread_mutex_unlock(&dev->lock);
+	if (ret != 0)
+		return -1;
+
+	req = malloc(sizeof(struct dev_req));
+	req->proc = proc;
+	req->len = len;
+	req->submitted = current_time();
+	req->next = NULL;
+
+	/* Blocked before the device can complete it */
+	block_proc(proc);
+	pthread_mutex_lock(&dev->lock);
+	req->slots = dev_service_time(dev, len);
+	if (dev->tail != NULL)
+		dev->tail->next = req;
+	else
+		dev->head = req;
+	dev->tail = req;
+	if (++dev->qlen > dev->max_qlen)
+		dev->max_qlen = dev->qlen;
+	dev->requests++;
+	dev->bytes += len;
+	pthread_mutex_unlock(&dev->lock);
+	return 0;
+}
+
+int dev_cancel(struct pcb_t *proc)
+{
+	struct dev_req **pp, *req, *prev;
+	int i;
+
+	for (i = 0; i < num_devs; i++)
+	{
+		struct dev_t *dev = &devs[i];
+
+		pthread_mutex_lock(&dev->lock);
+		prev = NULL;
+		for (pp = &dev->head; (req = *pp) != NULL; pp = &req->next)
+		{
+			if (req->proc != proc)
+			{
+				prev = req;
+				continue;
+			}
+			/* Dropped even in service, the next one takes over */
+			*pp = req->next;
+			if (dev->tail == req)
+				dev->tail = prev;
+			dev->qlen--;
+			dev->wait_slots += current_time() - req->submitted;
+			pthread_mutex_unlock(&dev->lock);
+			printf("\tDEV %s: Cancelled I/O of process %2d\n",
+			       dev->name, proc->pid);
+			free(req);
+			return 1;
+		}
+		pthread_mutex_unlock(&dev->lock);
+	}
+	return 0;
+}
+
+void dev_stat_dump(void)
+{
+	uint64_t now = dev_end;
+	int i;
+
+	if (num_devs == 0)
+		return;
+	printf("Device stats:\n");
+	printf("%3s %-8s %8s %8s %8s %8s %8s\n", "id", "name", "requests",
+	       "bytes", "util%", "avg_lat", "max_q");
+	for (i = 0; i < num_devs; i++)
+	{
+		struct dev_t *dev = &devs[i];
+
+		printf("%3d %-8s %8lu %8lu %8.1f %8.1f %8d\n", i, dev->name,
+		       dev->requests, dev->bytes,
+		       now ? 100.0 * dev->busy_slots / now : 0.0,
+		       dev->requests ? (double)dev->wait_slots / dev->requests : 0.0,
+		       dev->max_qlen);
+	}
+}
@@ -26,6 +26,63 @@
 // #define unlock_mm() printf("unlock_mm disabled to debug\n")
 static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Memmap ops are queued into the caller ring and run by one syscall.
+ * Queued ops only ever touch frames of the caller, in queue order, so
+ * only the caller direct memory accesses and its synchronous syscalls
+ * need the ring drained first. The ring is empty again whenever a
+ * library call returns.
+ */
+
+/*sysmem_submit - run the ops queued by the caller
+ *@caller: caller
+ *
+ */
+static int sysmem_submit(struct pcb_t* caller)
+{
+  struct sc_regs regs;
+
+  if (caller->sc_ring == NULL || caller->sc_ring->count == 0)
+    return 0;
+
+  regs.a1 = SYSMEM_BATCH_OP;
+  /* SYSCALL 17 sys_memmap */
+  return syscall(caller, 17, &regs) < 0 ? -1 : 0;
+}
+
+/*sysmem_sqe - queue a memmap op
+ *@caller: caller
+ *
+ * Return the entry to fill in, NULL if a full ring failed to drain
+ */
+static struct sc_regs* sysmem_sqe(struct pcb_t* caller)
+{
+  struct sc_ring* ring = caller->sc_ring;
+
+  if (ring == NULL)
+  {
+    ring = caller->sc_ring = malloc(sizeof(struct sc_ring));
+    ring->count = 0;
+  }
+  else if (ring->count == SC_RING_SZ && sysmem_submit(caller) != 0)
+    return NULL;
+
+  return &ring->sqe[ring->count++];
+}
+
+/*sysmem_call - synchronous memmap op, after the queued ones
+ *@caller: caller
+ *@regs: op arguments, results on return
+ *
+ */
+static int sysmem_call(struct pcb_t* caller, struct sc_regs* regs)
+{
+  if (sysmem_submit(caller) != 0)
+    return -1;
+  /* SYSCALL 17 sys_memmap */
+  return syscall(caller, 17, regs);
+}
+
 
 /*enlist_vm_freerg_list - add new rg to freerg_list
  *@mm: memory region
@@ -35,9 +92,9 @@ static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
 int enlist_vm_freerg_list(struct mm_struct* mm, struct vm_rg_struct* rg_elmt)
 {
   lock_mm();
-  struct vm_rg_struct* rg_node = mm->mmap->vm_freerg_list;
+  struct vm_area_struct* vma = get_vma_by_num(mm, rg_elmt->vmaid);
 
-  if (rg_elmt->rg_start >= rg_elmt->rg_end)
+  if (vma == NULL || rg_elmt->rg_start >= rg_elmt->rg_end)
   {
     unlock_mm();
 #ifdef VMDBG
@@ -48,11 +105,9 @@ int enlist_vm_freerg_list(struct mm_struct* mm, struct vm_rg_struct* rg_elmt)
     return -1;
   }
 
-  if (rg_node != NULL)
-    rg_elmt->rg_next = rg_node;
-
   /* Enlist the new region */
-  mm->mmap->vm_freerg_list = rg_elmt;
+  rg_elmt->rg_next = vma->vm_freerg_list;
+  vma->vm_freerg_list = rg_elmt;
   unlock_mm();
   return 0;
 }
@@ -62,27 +117,78 @@ int enlist_vm_freerg_list(struct mm_struct* mm, struct vm_rg_struct* rg_elmt)
  *@mm: memory region
  *@rgid: region ID act as symbol index of variable
  *
+ * Return NULL when no region with this ID was ever recorded
  */
 struct vm_rg_struct* get_symrg_byid(struct mm_struct* mm, int rgid)
 {
-  if (rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ)
+  int pg = rgid / PAGING_SYMTBL_PGSZ;
+
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ ||
+      pg >= mm->symrgtbl_npg || mm->symrgtbl[pg] == NULL)
+    return NULL;
+
+  return &mm->symrgtbl[pg][rgid % PAGING_SYMTBL_PGSZ];
+}
+
+/*alloc_symrg_byid - get mem region by region ID, growing the table
+ *@mm: memory region
+ *@rgid: region ID act as symbol index of variable
+ *
+ */
+struct vm_rg_struct* alloc_symrg_byid(struct mm_struct* mm, int rgid)
+{
+  int pg = rgid / PAGING_SYMTBL_PGSZ;
+  int npg;
+
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
     return NULL;
 
-  return &mm->symrgtbl[rgid];
+  if (pg >= mm->symrgtbl_npg)
+  {
+    /* Double the directory, it stays tiny for small processes */
+    npg = mm->symrgtbl_npg ? mm->symrgtbl_npg * 2 : 1;
+    while (npg <= pg)
+      npg *= 2;
+
+    struct vm_rg_struct** dir = realloc(mm->symrgtbl, npg * sizeof(*dir));
+    if (dir == NULL)
+      return NULL;
+    memset(dir + mm->symrgtbl_npg, 0, (npg - mm->symrgtbl_npg) * sizeof(*dir));
+    mm->symrgtbl = dir;
+    mm->symrgtbl_npg = npg;
+  }
+
+  if (mm->symrgtbl[pg] == NULL)
+  {
+    mm->symrgtbl[pg] = calloc(PAGING_SYMTBL_PGSZ, sizeof(struct vm_rg_struct));
+    if (mm->symrgtbl[pg] == NULL)
+      return NULL;
+  }
+
+  return &mm->symrgtbl[pg][rgid % PAGING_SYMTBL_PGSZ];
 }
 
 int __alloc(struct pcb_t* caller, int vmaid, int rgid, int size, int* alloc_addr)
 {
   // printf("alloc: %d\n", size);
   struct vm_rg_struct rgnode;
+  struct vm_rg_struct* symrg;
+
+  lock_mm();
+  symrg = alloc_symrg_byid(caller->mm, rgid);
+  unlock_mm();
+  if (symrg == NULL)
+    return -1;
+
   //no need lock here
   /* TODO: commit the vmaid */
   if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0)
   {
     lock_mm();
     // printf("get_free_vmrg_area OK\n");
-    caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-    caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
+    symrg->rg_start = rgnode.rg_start;
+    symrg->rg_end = rgnode.rg_end;
+    symrg->vmaid = vmaid;
     *alloc_addr = rgnode.rg_start;
 #ifdef VMDBG
     printf("===== PHYSICAL MEMORY AFTER ALLOCATION =====\n");
@@ -97,10 +203,16 @@ int __alloc(struct pcb_t* caller, int vmaid, int rgid, int size, int* alloc_addr
   // printf("get_free_vmrg_area FAILED\n");
   /* TODO retrive current vma if needed, current comment out due to compiler redundant warning*/
   struct vm_area_struct* cur_vma = get_vma_by_num(caller->mm, vmaid);
+  if (cur_vma == NULL)
+  {
+    unlock_mm();
+    return -1;
+  }
 
   /* TODO retrive old_sbrk if needed, current comment out due to compiler redundant warning*/
   /*Attempt to increase limit to get space */
   int old_sbrk = cur_vma->sbrk;
+  int growsdown = cur_vma->vm_flags & VM_GROWSDOWN;
 
 
   int inc_sz = PAGING_PAGE_ALIGNSZ(size);
@@ -111,18 +223,22 @@ int __alloc(struct pcb_t* caller, int vmaid, int rgid, int size, int* alloc_addr
   regs.a3 = inc_sz;
   /* SYSCALL 17 sys_memmap */
   // to APIs in mm-vm.c
-  if (syscall(caller, 17, &regs) < -1)
+  if (sysmem_call(caller, &regs) < 0)
   {
     printf("Error: Syscall 17 failed\n");
     return -1;
   }
   lock_mm();
   /* TODO: commit the limit increment */
-  //add the new region to the free list
+  //add the new region to the free list, below the old break for a stack
   struct vm_area_struct* cur = get_vma_by_num(caller->mm, vmaid);
 
-  enlist_vm_rg_node(&cur->vm_freerg_list,
-                    init_vm_rg(old_sbrk, old_sbrk + inc_sz));
+  if (growsdown)
+    enlist_vm_rg_node(&cur->vm_freerg_list,
+                      init_vm_rg(caller->mm, old_sbrk - inc_sz, old_sbrk));
+  else
+    enlist_vm_rg_node(&cur->vm_freerg_list,
+                      init_vm_rg(caller->mm, old_sbrk, old_sbrk + inc_sz));
   unlock_mm();
   if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0)
   {
@@ -131,8 +247,9 @@ int __alloc(struct pcb_t* caller, int vmaid, int rgid, int size, int* alloc_addr
 
   lock_mm();
   //record region to symbol table
-  caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-  caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
+  symrg->rg_start = rgnode.rg_start;
+  symrg->rg_end = rgnode.rg_end;
+  symrg->vmaid = vmaid;
   unlock_mm();
   /* TODO: commit the allocation address*/
   *alloc_addr = rgnode.rg_start;
@@ -148,11 +265,18 @@ int __free(struct pcb_t* caller, int vmaid, int rgid)
 {
   lock_mm();
   struct vm_rg_struct* rgnode = get_symrg_byid(caller->mm, rgid);
-  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ || rgnode == NULL)
+  if (rgnode == NULL)
   {
     unlock_mm();
     return -1;
   }
+  unlock_mm();
+
+  /* The pages of a shared region are not the heap's to hand out again */
+  if (__mm_shm_unmap(caller, rgid) == 0)
+    return 0;
+
+  lock_mm();
   // Dummy initialization for avoding compiler dummay warning
   // in incompleted TODO code rgnode will overwrite through implementing
   // the manipulation of rgid later
@@ -160,7 +284,8 @@ int __free(struct pcb_t* caller, int vmaid, int rgid)
   // freerg->rg_start = rgnode->rg_start;
   // freerg->rg_end = rgnode->rg_end;
   // freerg->rg_next = NULL;
-  struct vm_rg_struct* freerg = init_vm_rg(rgnode->rg_start, rgnode->rg_end);
+  struct vm_rg_struct* freerg = init_vm_rg(caller->mm, rgnode->rg_start, rgnode->rg_end);
+  freerg->vmaid = rgnode->vmaid;
 
   unlock_mm();
   if (enlist_vm_freerg_list(caller->mm, freerg) != 0)
@@ -180,10 +305,10 @@ int __free(struct pcb_t* caller, int vmaid, int rgid)
   return 0;
 }
 
-int liballoc(struct pcb_t* proc, uint32_t size, uint32_t reg_index)
+int liballoc(struct pcb_t* proc, uint32_t size, uint32_t reg_index, uint32_t vmaid)
 {
   int addr;
-  int rc = __alloc(proc, 0, reg_index, size, &addr);
+  int rc = __alloc(proc, vmaid, reg_index, size, &addr);
   return rc;
 }
 
@@ -193,95 +318,480 @@ int libfree(struct pcb_t* proc, uint32_t reg_index)
   return __free(proc, 0, reg_index);
 }
 
-int pg_getpage(struct mm_struct* mm, int pgn, int* fpn, struct pcb_t* caller)
+/*
+ * Shared region registry, one entry per key for the whole system. It is
+ * guarded by mmvm_lock like the page tables it maps into, so a shared
+ * page is swapped out and back in every mapper at once.
+ */
+static struct shm_seg_struct shm_segs[SHM_MAX_SEGS];
+
+/*__shm_backing - frame or swap slot of a PTE, without the soft bits
+ *@pte: present page table entry
+ *
+ */
+static uint32_t __shm_backing(uint32_t pte)
 {
-  lock_mm();
-  uint32_t pte = mm->pgd[pgn];
+  uint32_t backing = 0;
 
-  if (!PAGING_PAGE_PRESENT(pte))
+  if (PAGING_PAGE_SWAPPED(pte))
+    pte_set_swap(&backing, 0, PAGING_PTE_SWP(pte));
+  else
+    pte_set_fpn(&backing, PAGING_PTE_FPN(pte));
+  return backing;
+}
+
+/*__pte_ref - take one more reference on the frame or swap slot of a PTE */
+static void __pte_ref(struct pcb_t* caller, uint32_t pte)
+{
+  if (PAGING_PAGE_SWAPPED(pte))
+    MEMPHY_ref_fp(caller->active_mswp, PAGING_PTE_SWP(pte));
+  else
+    MEMPHY_ref_fp(caller->mram, PAGING_PTE_FPN(pte));
+}
+
+/*__pte_unref - drop a reference on the frame or swap slot of a PTE */
+static void __pte_unref(struct pcb_t* caller, uint32_t pte)
+{
+  if (PAGING_PAGE_SWAPPED(pte))
+    MEMPHY_unref_fp(caller->active_mswp, PAGING_PTE_SWP(pte));
+  else
+    MEMPHY_unref_fp(caller->mram, PAGING_PTE_FPN(pte));
+}
+
+/*__shm_page - shared region page backed like a PTE, mmvm_lock must be held
+ *@pte: page table entry of a shared page
+ *@pgi: return the page index in the region
+ *
+ */
+static struct shm_seg_struct* __shm_page(uint32_t pte, int* pgi)
+{
+  uint32_t backing = __shm_backing(pte);
+  int i;
+
+  for (i = 0; i < SHM_MAX_SEGS; i++)
   {
-    /* Page is not online, make it actively living */
-    int vicpgn, swpfpn;
-    int vicfpn;
-    uint32_t vicpte;
+    struct shm_seg_struct* seg = &shm_segs[i];
 
-    /* TODO: Play with your paging theory here */
-    /* Find victim page */
-    unlock_mm();
-    find_victim_page(caller->mm, &vicpgn);
+    if (seg->maps == NULL)
+      continue;
+    for (*pgi = 0; *pgi < seg->npages; (*pgi)++)
+      if (seg->ptes[*pgi] == backing)
+        return seg;
+  }
+  return NULL;
+}
 
-    /* Get free frame in MEMSWP */
-    MEMPHY_get_freefp(caller->active_mswp, &swpfpn);
-    lock_mm();
-    vicpte = caller->mm->pgd[vicpgn]; /*finding the victim page
-                                                inside the page directory to get the
-                                                page table entry, after that get the victim frame number*/
-    vicfpn = PAGING_PTE_FPN(vicpte); //the victim frame storing our variable
-    /* TODO: Implement swap frame from MEMRAM to MEMSWP and vice versa*/
-    /* TODO copy victim frame to swap
-        * SWP(vicfpn <--> swpfpn)
-        * SYSCALL 17 sys_memmap
-        * with operation SYSMEM_SWP_OP
-        */
-    struct sc_regs regs;
-
-    regs.a1 = SYSMEM_SWP_OP;
-    regs.a2 = vicfpn;
-    regs.a3 = swpfpn;
-
-
-    /* SYSCALL 17 sys_memmap */
-    if (syscall(caller, 17, &regs) < 0)
+/*__shm_refs - references a shared region holds on each of its pages */
+static int __shm_refs(struct shm_seg_struct* seg)
+{
+  struct shm_map_struct* map;
+  int refs = 1;
+
+  for (map = seg->maps; map != NULL; map = map->next)
+    refs++;
+  return refs;
+}
+
+/*__shm_set_page - back a shared region page by a new frame or swap slot
+ *@seg: shared region
+ *@pgi: page index in the region
+ *@backing: frame or swap slot, PTE encoded
+ *
+ * Every mapping is updated, mmvm_lock must be held
+ */
+static void __shm_set_page(struct shm_seg_struct* seg, int pgi, uint32_t backing)
+{
+  struct shm_map_struct* map;
+
+  seg->ptes[pgi] = backing;
+  for (map = seg->maps; map != NULL; map = map->next)
+    map->proc->mm->pgd[map->pgn + pgi] = backing | PAGING_PTE_SHM_MASK;
+}
+
+/*__shm_evictable - whether a shared frame may leave MEMRAM now
+ *@seg: shared region
+ *@fpn: frame of one of its pages
+ *@caller: evicting process
+ *
+ * Another mapper on a CPU may be between looking the frame up and
+ * using it, a blocked one may wait on a futex keyed by its address.
+ * A private copy-on-write holder left by a detach also pins it.
+ */
+static int __shm_evictable(struct shm_seg_struct* seg, int fpn, struct pcb_t* caller)
+{
+  struct shm_map_struct* map;
+
+  for (map = seg->maps; map != NULL; map = map->next)
+    if (map->proc != caller &&
+        (__atomic_load_n(&map->proc->on_cpu, __ATOMIC_ACQUIRE) ||
+         __atomic_load_n(&map->proc->state, __ATOMIC_ACQUIRE) == PROC_BLOCKED))
+      return 0;
+  return MEMPHY_fp_refcnt(caller->mram, fpn) == __shm_refs(seg);
+}
+
+/*__find_victim_page - find victim page, mmvm_lock must be held
+ *@mm: memory region
+ *@retpgn: return page number
+ *
+ */
+static int __find_victim_page(struct mm_struct* mm, int* retpgn)
+{
+  struct pgn_t* prev_pg = NULL;
+  struct pgn_t* pg = mm->fifo_pgn;
+  if (pg == NULL)
+    return -1;
+
+  //traverse to end of list
+  while (pg->pg_next)
+  {
+    prev_pg = pg;
+    pg = pg->pg_next;
+  }
+
+  /* TODO: Implement the theorical mechanism to find the victim page */
+  // FIFO so the retrieved page is the last one
+  *retpgn = pg->pgn;
+  //remove last page
+  if (prev_pg) prev_pg->pg_next = NULL;
+  else mm->fifo_pgn = NULL;
+  objpool_put(&mm->pgn_pool, pg);
+  return 0;
+}
+
+/*__pg_evict - push the FIFO victim page to MEMSWP and hand out its frame
+ *@mm: memory region
+ *@skippgn: page that must stay online, -1 if none
+ *@caller: caller
+ *@retfpn: return the released MEMRAM frame
+ *
+ * mmvm_lock must be held. The swap out is only queued, the frame must
+ * not be touched but through the ring before sysmem_submit()
+ */
+static int __pg_evict(struct mm_struct* mm, int skippgn, struct pcb_t* caller, int* retfpn)
+{
+  int vicpgn, vicfpn, swpfpn, pgi, refs;
+  int skipfpn = -1;
+  int tries = 0;
+  uint32_t pte, backing = 0;
+  struct pgn_t* pg;
+  struct sc_regs* sqe;
+  struct shm_seg_struct* seg;
+
+  for (pg = mm->fifo_pgn; pg != NULL; pg = pg->pg_next)
+    tries++;
+
+  /* The page to keep may share its frame with another page */
+  if (skippgn >= 0 && PAGING_PAGE_PRESENT(mm->pgd[skippgn]) &&
+      !PAGING_PAGE_SWAPPED(mm->pgd[skippgn]))
+    skipfpn = PAGING_PTE_FPN(mm->pgd[skippgn]);
+
+  /* A frame still shared with another mm frees nothing when swapped out,
+   * rotate such pages to the young end and try the next one. A shared
+   * region frame is the exception, it leaves every mapper at once */
+  do {
+    if (tries-- <= 0 || __find_victim_page(mm, &vicpgn) != 0)
+      return -1;
+
+    /* Detached, or swapped out through another mapper, since queued */
+    pte = mm->pgd[vicpgn];
+    if (!PAGING_PAGE_PRESENT(pte) || PAGING_PAGE_SWAPPED(pte))
+      continue;
+
+    seg = NULL;
+    vicfpn = PAGING_PTE_FPN(pte);
+    if (vicfpn != skipfpn)
     {
-      unlock_mm();
-      return -1; //Syscall failed
+      if (!(pte & PAGING_PTE_SHM_MASK))
+      {
+        if (MEMPHY_fp_refcnt(caller->mram, vicfpn) <= 1)
+          break;
+      }
+      else if ((seg = __shm_page(pte, &pgi)) != NULL &&
+               __shm_evictable(seg, vicfpn, caller))
+        break;
     }
 
-    /* TODO copy target frame form swap to mem
-     * SWP(tgtfpn <--> vicfpn)
-     * SYSCALL 17 sys_memmap
-     * with operation SYSMEM_SWP_OP
-     */
-
-    int tgtfpn = PAGING_PTE_FPN(pte); //the target frame storing our variable
-
-    /* TODO copy target frame form swap to mem
-    //regs.a1 =...
-    //regs.a2 =...
-    //regs.a3 =..
-    */
-
-    regs.a1 = SYSMEM_SWP_OP;
-    regs.a2 = tgtfpn;
-    regs.a3 = vicfpn;
-    /* SYSCALL 17 sys_memmap */
-    if (syscall(caller, 17, &regs) < 0)
+    enlist_pgn_node(mm, &mm->fifo_pgn, vicpgn);
+  } while (1);
+
+  if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) != 0)
+  {
+    enlist_pgn_node(mm, &mm->fifo_pgn, vicpgn);
+    return -1;
+  }
+
+  /* SWP(vicfpn --> swpfpn) */
+  if ((sqe = sysmem_sqe(caller)) == NULL)
+  {
+    MEMPHY_put_freefp(caller->active_mswp, swpfpn);
+    enlist_pgn_node(mm, &mm->fifo_pgn, vicpgn);
+    return -1;
+  }
+  sqe->a1 = SYSMEM_SWP_OP;
+  sqe->a2 = vicfpn;
+  sqe->a3 = swpfpn;
+
+#ifdef MM_READAHEAD
+  /* A prefetched page leaving untouched is a readahead miss */
+  if (mm->pgd[vicpgn] & PAGING_PTE_RDAHEAD_MASK)
+  {
+    mm->ra_wasted++;
+    mm->ra_win /= 2;
+  }
+#endif
+
+  if (seg != NULL)
+  {
+    /* The mapper references move to the swap slot, the frame is
+     * handed out with the last one */
+    for (refs = __shm_refs(seg); refs > 1; refs--)
     {
-      unlock_mm();
-      return -1; //Syscall failed
+      MEMPHY_ref_fp(caller->active_mswp, swpfpn);
+      MEMPHY_unref_fp(caller->mram, vicfpn);
     }
-
-    /* Update page table */
-    //Mark the victim page as being swapped out, swapped it into the swpfpn number frame in the SWAP
+    pte_set_swap(&backing, 0, swpfpn);
+    __shm_set_page(seg, pgi, backing);
+  }
+  else
     pte_set_swap(&mm->pgd[vicpgn], 0, swpfpn);
-    //mm->pgd;
+  *retfpn = vicfpn;
+  return 0;
+}
+
+/*__pg_swapin - bring a swapped page back online, mmvm_lock must be held
+ *@mm: memory region
+ *@pgn: swapped page number
+ *@skippgn: page that must stay online, -1 if none
+ *@caller: caller
+ *
+ * The eviction and the swap in are queued, submitted by the caller
+ */
+static int __pg_swapin(struct mm_struct* mm, int pgn, int skippgn, struct pcb_t* caller)
+{
+  int tgtfpn, pgi, refs;
+  int swpfpn = PAGING_PTE_SWP(mm->pgd[pgn]);
+  uint32_t backing = 0;
+  struct sc_regs* sqe;
+  struct shm_seg_struct* seg;
+
+  /* Take a free frame first, only then play with the victim page */
+  if (MEMPHY_get_freefp(caller->mram, &tgtfpn) != 0 &&
+      __pg_evict(mm, skippgn, caller, &tgtfpn) != 0)
+    return -1;
+
+  /* SWP(swpfpn --> tgtfpn) */
+  if ((sqe = sysmem_sqe(caller)) == NULL)
+  {
+    MEMPHY_put_freefp(caller->mram, tgtfpn);
+    return -1;
+  }
+  sqe->a1 = SYSMEM_SWPIN_OP;
+  sqe->a2 = swpfpn;
+  sqe->a3 = tgtfpn;
+
+  if ((mm->pgd[pgn] & PAGING_PTE_SHM_MASK) &&
+      (seg = __shm_page(mm->pgd[pgn], &pgi)) != NULL)
+  {
+    /* Back online in every mapper, with all their references */
+    for (refs = __shm_refs(seg); refs > 1; refs--)
+    {
+      MEMPHY_ref_fp(caller->mram, tgtfpn);
+      MEMPHY_unref_fp(caller->active_mswp, swpfpn);
+    }
+    MEMPHY_unref_fp(caller->active_mswp, swpfpn);
+    pte_set_fpn(&backing, tgtfpn);
+    __shm_set_page(seg, pgi, backing);
+  }
+  else
+  {
+    /* The swap slot may still back the same page of a forked mm */
+    MEMPHY_unref_fp(caller->active_mswp, swpfpn);
+    pte_set_fpn(&mm->pgd[pgn], tgtfpn);
+  }
+  enlist_pgn_node(mm, &mm->fifo_pgn, pgn);
+  return 0;
+}
 
-    /* Update its online status of the target page */
-    /* Mark the target page as being present in RAM (online), the target page is mapped into RAM
-    at the frame vicfpn where the victim frame was before*/
-    pte_set_fpn(&mm->pgd[pgn], vicfpn);
+#ifdef MM_READAHEAD
+/*__pg_readahead - prefetch the pages following a sequential fault
+ *@mm: memory region
+ *@pgn: faulting page number (already online)
+ *@caller: caller
+ *
+ * The window doubles on every fault continuing the current stream and
+ * halves on a random one, so a scattered access pattern quickly stops
+ * paying for prefetch. The whole window is brought in under one lock
+ * acquisition. mmvm_lock must be held.
+ */
+static void __pg_readahead(struct mm_struct* mm, int pgn, struct pcb_t* caller)
+{
+  struct vm_area_struct* vma;
+  int pgit, endpgn;
+
+  if (pgn == mm->ra_lastpgn + 1)
+    mm->ra_win = (mm->ra_win == 0) ? PAGING_RA_INIT_WIN :
+                 (mm->ra_win * 2 > PAGING_RA_MAX_WIN) ? PAGING_RA_MAX_WIN : mm->ra_win * 2;
+  else
+    mm->ra_win /= 2;
+  mm->ra_lastpgn = pgn;
+
+  /* Never read ahead past the end of the faulting VMA */
+  vma = get_vma_by_addr(mm, pgn * PAGING_PAGESZ);
+  if (vma == NULL)
+    return;
+
+  endpgn = pgn + mm->ra_win;
+  if (endpgn > (int)(DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ) - 1))
+    endpgn = DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ) - 1;
+
+  for (pgit = pgn + 1; pgit <= endpgn; pgit++)
+  {
+    if (!PAGING_PAGE_SWAPPED(mm->pgd[pgit]))
+      continue;
 
-    //mm->pgd[pgn];
-    //pte_set_fpn();
+    if (__pg_swapin(mm, pgit, pgn, caller) != 0)
+      break;
 
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+    SETBIT(mm->pgd[pgit], PAGING_PTE_RDAHEAD_MASK);
+    mm->ra_issued++;
   }
+}
+#endif
 
-  *fpn = PAGING_FPN(mm->pgd[pgn]);
+/*pg_reclaim_frame - release one MEMRAM frame by swapping out a page
+ *@caller: caller
+ *@fpn: return the released frame
+ *
+ */
+int pg_reclaim_frame(struct pcb_t* caller, int* fpn)
+{
+  int ret;
+
+  lock_mm();
+  ret = __pg_evict(caller->mm, -1, caller, fpn);
+  if (sysmem_submit(caller) != 0)
+    ret = -1;
   unlock_mm();
+  return ret;
+}
+
+/*__pg_getpage - make a page online, mmvm_lock must be held
+ *@mm: memory region
+ *@pgn: page number
+ *@fpn: return frame number
+ *@caller: caller
+ *
+ */
+static int __pg_getpage(struct mm_struct* mm, int pgn, int* fpn, struct pcb_t* caller)
+{
+  uint32_t pte = mm->pgd[pgn];
+
+  if (!PAGING_PAGE_PRESENT(pte))
+    return -1; /* Page was never mapped */
+
+  if (PAGING_PAGE_SWAPPED(pte))
+  {
+    /* Page is not online, make it actively living */
+    mm->ra_faults++;
+    if (__pg_swapin(mm, pgn, -1, caller) != 0)
+      return -1;
+#ifdef MM_READAHEAD
+    __pg_readahead(mm, pgn, caller);
+#endif
+  }
+#ifdef MM_READAHEAD
+  else if (pte & PAGING_PTE_RDAHEAD_MASK)
+  {
+    /* First touch of a prefetched page, the stream goes on */
+    CLRBIT(mm->pgd[pgn], PAGING_PTE_RDAHEAD_MASK);
+    mm->ra_hits++;
+    mm->ra_lastpgn = pgn;
+    if (mm->ra_win < PAGING_RA_MAX_WIN)
+      mm->ra_win++;
+  }
+#endif
+
+  *fpn = PAGING_FPN(mm->pgd[pgn]);
+  return 0;
+}
+
+/*__pg_cow_break - give a write protected page its private frame
+ *@mm: memory region
+ *@pgn: online page number
+ *@fpn: in/out frame number
+ *@caller: caller
+ *
+ * mmvm_lock must be held, the copy is queued
+ */
+static int __pg_cow_break(struct mm_struct* mm, int pgn, int* fpn, struct pcb_t* caller)
+{
+  int newfpn;
+  struct sc_regs* sqe;
+
+  if (!(mm->pgd[pgn] & PAGING_PTE_COW_MASK))
+    return 0;
+
+  /* Last user of the frame, just take it back */
+  if (MEMPHY_fp_refcnt(caller->mram, *fpn) <= 1)
+  {
+    CLRBIT(mm->pgd[pgn], PAGING_PTE_COW_MASK);
+    return 0;
+  }
+
+  if (MEMPHY_get_freefp(caller->mram, &newfpn) != 0 &&
+      __pg_evict(mm, pgn, caller, &newfpn) != 0)
+    return -1;
+
+  /* CP(fpn --> newfpn) */
+  if ((sqe = sysmem_sqe(caller)) == NULL)
+  {
+    MEMPHY_put_freefp(caller->mram, newfpn);
+    return -1;
+  }
+  sqe->a1 = SYSMEM_COW_OP;
+  sqe->a2 = *fpn;
+  sqe->a3 = newfpn;
+
+  MEMPHY_unref_fp(caller->mram, *fpn);
+  pte_set_fpn(&mm->pgd[pgn], newfpn);
+  *fpn = newfpn;
   return 0;
 }
 
+int pg_getpage(struct mm_struct* mm, int pgn, int* fpn, struct pcb_t* caller)
+{
+  int ret;
+
+  lock_mm();
+  ret = __pg_getpage(mm, pgn, fpn, caller);
+  /* Swaps, with any readahead, go to the kernel as one batch */
+  if (sysmem_submit(caller) != 0)
+    ret = -1;
+  unlock_mm();
+  return ret;
+}
+
+/*pg_getpage_wr - make a page online and writable
+ *@mm: memory region
+ *@pgn: page number
+ *@fpn: return frame number
+ *@caller: caller
+ *
+ */
+static int pg_getpage_wr(struct mm_struct* mm, int pgn, int* fpn, struct pcb_t* caller)
+{
+  int ret;
+
+  lock_mm();
+  ret = __pg_getpage(mm, pgn, fpn, caller);
+  if (ret == 0)
+    ret = __pg_cow_break(mm, pgn, fpn, caller);
+  if (sysmem_submit(caller) != 0)
+    ret = -1;
+  unlock_mm();
+  return ret;
+}
+
 
 /*pg_getval - read value at given offset
  *@mm: memory region
@@ -303,15 +813,14 @@ int pg_getval(struct mm_struct* mm, int addr, BYTE* data, struct pcb_t* caller)
   // printf("IM PHYSICAL ADDRESS %d\n", phyaddr);
   // MEMPHY_read(caller->mram, phyaddr, data);
 
-  struct sc_regs* regs = malloc(sizeof(struct sc_regs));
-  regs->a1 = SYSMEM_IO_READ;
-  regs->a2 = phyaddr;
-  if (syscall(caller, 17, regs) < 0)
+  struct sc_regs regs;
+  regs.a1 = SYSMEM_IO_READ;
+  regs.a2 = phyaddr;
+  if (sysmem_call(caller, &regs) < 0)
   {
     return -1; //Syscall failed
   }
-  *data = regs->a3;
-  free(regs);
+  *data = regs.a3;
   return 0;
 }
 
@@ -327,17 +836,18 @@ int pg_setval(struct mm_struct* mm, int addr, BYTE value, struct pcb_t* caller)
   int off = PAGING_OFFST(addr);
   int fpn;
 
-  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+  /* Get the page to MEMRAM, swap from MEMSWAP if needed
+   * and break the copy-on-write sharing */
+  if (pg_getpage_wr(mm, pgn, &fpn, caller) != 0)
     return -1; /* invalid page access */
 
   int phyaddr = (fpn * PAGING_PAGESZ) + off;
 
-  struct sc_regs* regs = malloc(sizeof(struct sc_regs));
-  regs->a1 = SYSMEM_IO_WRITE;
-  regs->a2 = phyaddr;
-  regs->a3 = value;
-  if (syscall(caller, 17, regs) < 0)
+  struct sc_regs regs;
+  regs.a1 = SYSMEM_IO_WRITE;
+  regs.a2 = phyaddr;
+  regs.a3 = value;
+  if (sysmem_call(caller, &regs) < 0)
   {
     return -1; //Syscall failed
   }
@@ -345,7 +855,6 @@ int pg_setval(struct mm_struct* mm, int addr, BYTE value, struct pcb_t* caller)
 
   // Update data
   // data = (BYTE)
-  free(regs);
   return 0;
 }
 
@@ -360,19 +869,20 @@ int pg_setval(struct mm_struct* mm, int addr, BYTE value, struct pcb_t* caller)
 int __read(struct pcb_t* caller, int vmaid, int rgid, int offset, BYTE* data)
 {
   struct vm_rg_struct* currg = get_symrg_byid(caller->mm, rgid);
-  struct vm_area_struct* cur_vma = get_vma_by_num(caller->mm, vmaid);
 
-  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  if (currg == NULL) /* Invalid memory identify */
     return -1;
 
-  pg_getval(caller->mm, currg->rg_start + offset, data, caller);
+  /* The region knows its own vm area */
+  if (get_vma_by_num(caller->mm, currg->vmaid) == NULL)
+    return -1;
 
-  return 0;
+  return pg_getval(caller->mm, currg->rg_start + offset, data, caller);
 }
 
 int libread(struct pcb_t* proc, uint32_t source, uint32_t offset, uint32_t* destination)
 {
-  BYTE data;
+  BYTE data = 0;
   int val = __read(proc, 0, source, offset, &data);
   *destination = data;
 
@@ -398,14 +908,15 @@ int libread(struct pcb_t* proc, uint32_t source, uint32_t offset, uint32_t* dest
 int __write(struct pcb_t* caller, int vmaid, int rgid, int offset, BYTE value)
 {
   struct vm_rg_struct* currg = get_symrg_byid(caller->mm, rgid);
-  struct vm_area_struct* cur_vma = get_vma_by_num(caller->mm, vmaid);
 
-  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  if (currg == NULL) /* Invalid memory identify */
     return -1;
 
-  pg_setval(caller->mm, currg->rg_start + offset, value, caller);
+  /* The region knows its own vm area */
+  if (get_vma_by_num(caller->mm, currg->vmaid) == NULL)
+    return -1;
 
-  return 0;
+  return pg_setval(caller->mm, currg->rg_start + offset, value, caller);
 }
 
 /*libwrite - PAGING-based write a region memory */
@@ -427,70 +938,842 @@ int libwrite(
   return val;
 }
 
-/*free_pcb_memphy - collect all memphy of pcb
+/*__rg_block - resolve a region block
  *@caller: caller
- *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
+ *@rgid: memory region ID
+ *@offset: offset of the block in the region
+ *@len: block length
+ *
+ * Return the virtual address of the block, -1 if it does not fit in
+ * the region
  */
-int free_pcb_memph(struct pcb_t* caller)
+static int __rg_block(struct pcb_t* caller, int rgid, int offset, int len)
+{
+  struct vm_rg_struct* currg = get_symrg_byid(caller->mm, rgid);
+
+  if (currg == NULL || offset < 0 || len < 0 ||
+      get_vma_by_num(caller->mm, currg->vmaid) == NULL)
+    return -1;
+  if (currg->rg_start + offset + len > currg->rg_end)
+    return -1;
+  return currg->rg_start + offset;
+}
+
+/*pg_getpair - bring a source and a destination page online together
+ *@mm: memory region
+ *@srcpgn: source page, read only
+ *@dstpgn: destination page, made writable
+ *
+ * Onlining the destination may evict the source when RAM is tight, in
+ * which case it is tried once more. Return -2 when RAM cannot hold both.
+ */
+static int pg_getpair(struct mm_struct* mm, int srcpgn, int dstpgn,
+                      int* srcfpn, int* dstfpn, struct pcb_t* caller)
 {
-  int pagenum, fpn;
   uint32_t pte;
+  int try;
 
-  lock_mm();
-  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
+  for (try = 0; try < 2; try++)
   {
-    pte = caller->mm->pgd[pagenum];
+    if (pg_getpage(mm, srcpgn, srcfpn, caller) != 0 ||
+        pg_getpage_wr(mm, dstpgn, dstfpn, caller) != 0)
+      return -1;
+
+    pte = mm->pgd[srcpgn];
+    if (PAGING_PAGE_PRESENT(pte) && !PAGING_PAGE_SWAPPED(pte) &&
+        PAGING_PTE_FPN(pte) == *srcfpn)
+      return 0;
+  }
+  return -2;
+}
 
-    if (!PAGING_PAGE_PRESENT(pte))
+/*__copy - copy a block between two regions
+ *@caller: caller
+ *@srcrg, srcoff: source region ID and offset
+ *@dstrg, dstoff: destination region ID and offset
+ *@len: number of bytes
+ *
+ * Both sides are translated once per page and each chunk, bounded by
+ * the nearer page end, is queued as one SYSMEM_IO_COPY. The chunks go
+ * to the kernel in one batch, where physically adjacent ones merge
+ */
+int __copy(struct pcb_t* caller, int srcrg, int srcoff, int dstrg, int dstoff, int len)
+{
+  int src = __rg_block(caller, srcrg, srcoff, len);
+  int dst = __rg_block(caller, dstrg, dstoff, len);
+  struct sc_regs* sqe;
+  int chunk, srcfpn, dstfpn, ret = 0;
+  BYTE data;
+
+  if (src < 0 || dst < 0)
+    return -1;
+
+  while (len > 0)
+  {
+    chunk = PAGING_PAGESZ - PAGING_OFFST(src);
+    if (chunk > PAGING_PAGESZ - PAGING_OFFST(dst))
+      chunk = PAGING_PAGESZ - PAGING_OFFST(dst);
+    if (chunk > len)
+      chunk = len;
+
+    ret = pg_getpair(caller->mm, PAGING_PGN(src), PAGING_PGN(dst),
+                     &srcfpn, &dstfpn, caller);
+    if (ret == -2)
     {
-      fpn = PAGING_PTE_FPN(pte);
-      MEMPHY_put_freefp(caller->mram, fpn);
+      /* Not enough RAM for both pages, bounce byte by byte */
+      ret = 0;
+      for (int i = 0; i < chunk && ret == 0; i++)
+        if (pg_getval(caller->mm, src + i, &data, caller) != 0 ||
+            pg_setval(caller->mm, dst + i, data, caller) != 0)
+          ret = -1;
     }
-    else
+    else if (ret == 0)
     {
-      fpn = PAGING_PTE_SWP(pte);
-      MEMPHY_put_freefp(caller->active_mswp, fpn);
+      if ((sqe = sysmem_sqe(caller)) == NULL)
+      {
+        ret = -1;
+        break;
+      }
+      sqe->a1 = SYSMEM_IO_COPY;
+      sqe->a2 = srcfpn * PAGING_PAGESZ + PAGING_OFFST(src);
+      sqe->a3 = dstfpn * PAGING_PAGESZ + PAGING_OFFST(dst);
+      sqe->a4 = chunk;
     }
+    if (ret != 0)
+      break;
+
+    src += chunk;
+    dst += chunk;
+    len -= chunk;
+  }
+
+  /* Chunks queued before a failure still run */
+  if (sysmem_submit(caller) != 0)
+    ret = -1;
+  return ret;
+}
+
+/*__fill - set a block of a region to one value
+ *@caller: caller
+ *@rgid: memory region ID
+ *@offset: offset in the region
+ *@value: byte value
+ *@len: number of bytes
+ */
+int __fill(struct pcb_t* caller, int rgid, int offset, BYTE value, int len)
+{
+  int addr = __rg_block(caller, rgid, offset, len);
+  struct sc_regs* sqe;
+  int chunk, fpn, ret = 0;
+
+  if (addr < 0)
+    return -1;
+
+  while (len > 0)
+  {
+    chunk = PAGING_PAGESZ - PAGING_OFFST(addr);
+    if (chunk > len)
+      chunk = len;
+
+    if (pg_getpage_wr(caller->mm, PAGING_PGN(addr), &fpn, caller) != 0 ||
+        (sqe = sysmem_sqe(caller)) == NULL)
+    {
+      ret = -1;
+      break;
+    }
+    sqe->a1 = SYSMEM_IO_FILL;
+    sqe->a2 = fpn * PAGING_PAGESZ + PAGING_OFFST(addr);
+    sqe->a3 = (BYTE)value;
+    sqe->a4 = chunk;
+
+    addr += chunk;
+    len -= chunk;
+  }
+
+  /* Chunks queued before a failure still run */
+  if (sysmem_submit(caller) != 0)
+    ret = -1;
+  return ret;
+}
+
+/*__rg_size - size of a region
+ *@caller: caller
+ *@rgid: memory region ID
+ *
+ * Return -1 for a region that does not exist
+ */
+int __rg_size(struct pcb_t* caller, int rgid)
+{
+  struct vm_rg_struct* currg = get_symrg_byid(caller->mm, rgid);
+
+  if (currg == NULL || get_vma_by_num(caller->mm, currg->vmaid) == NULL)
+    return -1;
+  return currg->rg_end - currg->rg_start;
+}
+
+/*__rg_paddr - physical address of a region byte
+ *@caller: caller
+ *@rgid: memory region ID
+ *@offset: offset in the region
+ *
+ * The page is brought online first. Return -1 on a bad address
+ */
+int __rg_paddr(struct pcb_t* caller, int rgid, int offset)
+{
+  int addr = __rg_block(caller, rgid, offset, 1);
+  int fpn;
+
+  if (addr < 0 || pg_getpage(caller->mm, PAGING_PGN(addr), &fpn, caller) != 0)
+    return -1;
+  return fpn * PAGING_PAGESZ + PAGING_OFFST(addr);
+}
+
+/*__read_block - kernel read of a region block into a buffer
+ *@caller: caller
+ *@rgid: memory region ID
+ *@offset: offset in the region
+ *@buf: kernel buffer
+ *@len: number of bytes
+ *
+ * The kernel side of user copies, pages are translated once and read in
+ * chunks straight from MEMRAM, with no syscall and no dump
+ */
+int __read_block(struct pcb_t* caller, int rgid, int offset, BYTE* buf, int len)
+{
+  int addr = __rg_block(caller, rgid, offset, len);
+  int chunk, fpn;
+
+  if (addr < 0)
+    return -1;
+
+  while (len > 0)
+  {
+    chunk = PAGING_PAGESZ - PAGING_OFFST(addr);
+    if (chunk > len)
+      chunk = len;
+
+    if (pg_getpage(caller->mm, PAGING_PGN(addr), &fpn, caller) != 0 ||
+        MEMPHY_read_block(caller->mram, fpn * PAGING_PAGESZ + PAGING_OFFST(addr),
+                          buf, chunk) != 0)
+      return -1;
+
+    addr += chunk;
+    buf += chunk;
+    len -= chunk;
   }
-  unlock_mm();
   return 0;
 }
 
+/*__write_block - kernel write of a buffer into a region block
+ *@caller: caller
+ *@rgid: memory region ID
+ *@offset: offset in the region
+ *@buf: kernel buffer
+ *@len: number of bytes
+ */
+int __write_block(struct pcb_t* caller, int rgid, int offset, const BYTE* buf, int len)
+{
+  int addr = __rg_block(caller, rgid, offset, len);
+  int chunk, fpn;
 
-/*find_victim_page - find victim page
+  if (addr < 0)
+    return -1;
+
+  while (len > 0)
+  {
+    chunk = PAGING_PAGESZ - PAGING_OFFST(addr);
+    if (chunk > len)
+      chunk = len;
+
+    if (pg_getpage_wr(caller->mm, PAGING_PGN(addr), &fpn, caller) != 0 ||
+        MEMPHY_write_block(caller->mram, fpn * PAGING_PAGESZ + PAGING_OFFST(addr),
+                           buf, chunk) != 0)
+      return -1;
+
+    addr += chunk;
+    buf += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
+
+/*libcopy - PAGING-based copy between two regions */
+int libcopy(
+  struct pcb_t* proc, // Process executing the instruction
+  uint32_t source, // Source region ID
+  uint32_t destination, // Destination region ID
+  uint32_t size) // Number of bytes from offset 0 of both
+{
+  int val = __copy(proc, source, 0, destination, 0, size);
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER COPYING =====\n");
+  printf("copy region=%d to region=%d size=%d\n", source, destination, size);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); //print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+  return val;
+}
+
+/*libfill - PAGING-based fill of a region */
+int libfill(
+  struct pcb_t* proc, // Process executing the instruction
+  uint32_t destination, // Region ID
+  BYTE value, // Byte written
+  uint32_t size) // Number of bytes from offset 0
+{
+  int val = __fill(proc, destination, 0, value, size);
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER FILLING =====\n");
+  printf("fill region=%d value=%d size=%d\n", destination, value, size);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); //print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+  return val;
+}
+
+/*__shm_map_of - shared mapping named by a region ID, mmvm_lock must be held
  *@caller: caller
- *@pgn: return page number
+ *@rgid: region ID
+ *@segp: return the shared region
  *
  */
-int find_victim_page(struct mm_struct* mm, int* retpgn)
+static struct shm_map_struct* __shm_map_of(struct pcb_t* caller, int rgid,
+                                           struct shm_seg_struct** segp)
+{
+  struct shm_map_struct* map;
+  int i;
+
+  for (i = 0; i < SHM_MAX_SEGS; i++)
+    for (map = shm_segs[i].maps; map != NULL; map = map->next)
+      if (map->proc == caller && map->rgid == rgid)
+      {
+        *segp = &shm_segs[i];
+        return map;
+      }
+  return NULL;
+}
+
+/*__shm_destroy - release a shared region nobody maps any more
+ *@caller: caller, for its memory devices
+ *@seg: shared region
+ *
+ */
+static void __shm_destroy(struct pcb_t* caller, struct shm_seg_struct* seg)
+{
+  int pgit;
+
+  for (pgit = 0; pgit < seg->npages; pgit++)
+    __pte_unref(caller, seg->ptes[pgit]);
+  free(seg->ptes);
+  seg->ptes = NULL;
+  seg->npages = 0;
+}
+
+/*__shm_unlink - drop a mapping from its shared region
+ *@seg: shared region
+ *@map: mapping, freed
+ *
+ * Return 1 if it was the last one, the caller then destroys the region
+ */
+static int __shm_unlink(struct shm_seg_struct* seg, struct shm_map_struct* map)
+{
+  struct shm_map_struct** pp;
+
+  for (pp = &seg->maps; *pp != map; pp = &(*pp)->next)
+    ;
+  *pp = map->next;
+  free(map);
+  return seg->maps == NULL;
+}
+
+/*__shm_detach - unmap a shared region from the process of a mapping
+ *@seg: shared region
+ *@map: mapping
+ *
+ * The pages go with their references. A published region may share
+ * its first and last page with other data of the process, such a page
+ * stays mapped as a private copy-on-write page. mmvm_lock must be held.
+ */
+static void __shm_detach(struct shm_seg_struct* seg, struct shm_map_struct* map)
+{
+  struct pcb_t* proc = map->proc;
+  int rg_end = seg->rg_off + seg->rg_sz;
+  uint32_t* pte;
+  int pgit;
+
+  for (pgit = 0; pgit < seg->npages; pgit++)
+  {
+    pte = &proc->mm->pgd[map->pgn + pgit];
+    if (!map->whole &&
+        ((pgit == 0 && seg->rg_off != 0) ||
+         (pgit == seg->npages - 1 && rg_end % PAGING_PAGESZ != 0)))
+    {
+      CLRBIT(*pte, PAGING_PTE_SHM_MASK);
+      if (!PAGING_PAGE_SWAPPED(*pte))
+        SETBIT(*pte, PAGING_PTE_COW_MASK);
+      continue;
+    }
+    __pte_unref(proc, *pte);
+    *pte = 0;
+  }
+
+  if (__shm_unlink(seg, map))
+    __shm_destroy(proc, seg);
+}
+
+/*__shm_publish - turn an allocated region into a shared region
+ *@caller: caller
+ *@key: name of the new shared region
+ *@rgid: region ID of the caller
+ *@rg: allocated region
+ *
+ * Whole pages are shared. They are all made online and private first,
+ * nothing is marked shared unless every one of them made it. mmvm_lock
+ * must be held.
+ */
+static int __shm_publish(struct pcb_t* caller, int key, int rgid, struct vm_rg_struct* rg)
 {
+  struct mm_struct* mm = caller->mm;
+  struct shm_seg_struct* seg = NULL;
+  struct shm_map_struct* map;
+  int pgn, npages, pgit, fpn, i;
+
+  if (rg->rg_end <= rg->rg_start)
+    return -1;
+
+  for (i = 0; i < SHM_MAX_SEGS && seg == NULL; i++)
+    if (shm_segs[i].maps == NULL)
+      seg = &shm_segs[i];
+  if (seg == NULL)
+    return -1;
+
+  pgn = PAGING_PGN(rg->rg_start);
+  npages = DIV_ROUND_UP(rg->rg_end, PAGING_PAGESZ) - pgn;
+
+  /* A page already shared, by a neighbour region, cannot join another */
+  for (pgit = 0; pgit < npages; pgit++)
+    if (mm->pgd[pgn + pgit] & PAGING_PTE_SHM_MASK)
+      return -1;
+
+  for (pgit = 0; pgit < npages; pgit++)
+    if (__pg_getpage(mm, pgn + pgit, &fpn, caller) != 0 ||
+        __pg_cow_break(mm, pgn + pgit, &fpn, caller) != 0)
+      break;
+  /* What was queued leaves the pages private either way */
+  if (sysmem_submit(caller) != 0 || pgit < npages)
+    return -1;
+
+  seg->ptes = malloc(npages * sizeof(uint32_t));
+  map = malloc(sizeof(struct shm_map_struct));
+  if (seg->ptes == NULL || map == NULL)
+  {
+    free(seg->ptes);
+    seg->ptes = NULL;
+    free(map);
+    return -1;
+  }
+
+  seg->key = key;
+  seg->npages = npages;
+  seg->rg_off = PAGING_OFFST(rg->rg_start);
+  seg->rg_sz = rg->rg_end - rg->rg_start;
+  map->proc = caller;
+  map->pgn = pgn;
+  map->rgid = rgid;
+  map->whole = 0;
+  map->next = NULL;
+  seg->maps = map;
+
+  /* Pages later evicted are swapped out, the segment takes them as is */
+  for (pgit = 0; pgit < npages; pgit++)
+  {
+    __pte_ref(caller, mm->pgd[pgn + pgit]);
+    seg->ptes[pgit] = __shm_backing(mm->pgd[pgn + pgit]);
+    SETBIT(mm->pgd[pgn + pgit], PAGING_PTE_SHM_MASK);
+  }
+  return 0;
+}
+
+/*__shm_release_rg - let go of what a region ID names before reusing it
+ *@caller: caller
+ *@rgid: region ID
+ *@rg: its symbol table entry
+ *
+ * A shared region is detached, a private one goes to the free list of
+ * its area. mmvm_lock must be held.
+ */
+static void __shm_release_rg(struct pcb_t* caller, int rgid, struct vm_rg_struct* rg)
+{
+  struct shm_seg_struct* seg;
+  struct shm_map_struct* map;
+  struct vm_area_struct* vma;
+
+  if (rg->rg_end <= rg->rg_start)
+    return;
+
+  if ((map = __shm_map_of(caller, rgid, &seg)) != NULL)
+    __shm_detach(seg, map);
+  else if ((vma = get_vma_by_num(caller->mm, rg->vmaid)) != NULL)
+    enlist_vm_rg_node(&vma->vm_freerg_list,
+                      init_vm_rg(caller->mm, rg->rg_start, rg->rg_end));
+  rg->rg_start = rg->rg_end = 0;
+}
+
+/*__shm_attach - map a shared region at the break of the caller mmap area
+ *@caller: caller
+ *@seg: shared region
+ *@rgid: region ID receiving the mapping
+ *@rg: its symbol table entry
+ *
+ * A region already named by @rgid is released once the mapping is sure
+ * to succeed. mmvm_lock must be held.
+ */
+static int __shm_attach(struct pcb_t* caller, struct shm_seg_struct* seg,
+                        int rgid, struct vm_rg_struct* rg)
+{
+  struct vm_area_struct* cur_vma = get_vma_by_num(caller->mm, PAGING_VMA_MMAP);
+  struct shm_map_struct* map;
+  int base, pgn, pgit;
+
+  if (cur_vma == NULL)
+    return -1;
+
+  base = PAGING_PAGE_ALIGNSZ(cur_vma->sbrk);
+  if (validate_overlap_vm_area(caller, PAGING_VMA_MMAP, base,
+                               base + seg->npages * PAGING_PAGESZ) < 0)
+    return -1;
+  if ((map = malloc(sizeof(struct shm_map_struct))) == NULL)
+    return -1;
+
+  __shm_release_rg(caller, rgid, rg);
+
+  /* Grow the area without taking frames, they come from the segment */
+  cur_vma->vm_end = base + seg->npages * PAGING_PAGESZ;
+  cur_vma->sbrk = cur_vma->vm_end;
+
+  pgn = PAGING_PGN(base);
+  map->proc = caller;
+  map->pgn = pgn;
+  map->rgid = rgid;
+  map->whole = 1;
+  map->next = seg->maps;
+  seg->maps = map;
+  for (pgit = 0; pgit < seg->npages; pgit++)
+  {
+    __pte_ref(caller, seg->ptes[pgit]);
+    caller->mm->pgd[pgn + pgit] = seg->ptes[pgit] | PAGING_PTE_SHM_MASK;
+  }
+
+  rg->rg_start = base + seg->rg_off;
+  rg->rg_end = rg->rg_start + seg->rg_sz;
+  rg->vmaid = PAGING_VMA_MMAP;
+  return 0;
+}
+
+/*__mm_shm_map - create or attach a named shared region
+ *@caller: caller
+ *@key: name of the shared region
+ *@rgid: region ID of the caller
+ *
+ * An unknown key publishes the already allocated region @rgid, a known
+ * key maps the shared frames into the caller as region @rgid. All users
+ * read and write the same pages.
+ */
+int __mm_shm_map(struct pcb_t* caller, int key, int rgid)
+{
+  struct vm_rg_struct* rg;
+  struct shm_seg_struct *seg, *cur;
+  int ret = -1;
+  int i;
+
   lock_mm();
-  struct pgn_t* prev_pg = NULL;
-  struct pgn_t* pg = mm->fifo_pgn;
-  if (pg == NULL)
+  for (seg = NULL, i = 0; i < SHM_MAX_SEGS && seg == NULL; i++)
+    if (shm_segs[i].maps != NULL && shm_segs[i].key == key)
+      seg = &shm_segs[i];
+
+  if (seg == NULL)
   {
-    unlock_mm();
+    /* A region already shared is not published a second time */
+    if ((rg = get_symrg_byid(caller->mm, rgid)) != NULL &&
+        __shm_map_of(caller, rgid, &cur) == NULL)
+      ret = __shm_publish(caller, key, rgid, rg);
+  }
+  else if (__shm_map_of(caller, rgid, &cur) != NULL && cur == seg)
+  {
+    ret = 0; /* already attached there */
+  }
+  else if ((rg = alloc_symrg_byid(caller->mm, rgid)) != NULL)
+  {
+    ret = __shm_attach(caller, seg, rgid, rg);
+  }
+  unlock_mm();
+
+#ifdef VMDBG
+  printf("PID=%d shm key=%d region=%d %s%s\n", caller->pid, key, rgid,
+         seg ? "attach" : "create", ret ? " FAILED" : "");
+#endif
+  return ret;
+}
+
+/*__mm_shm_unmap - detach a shared region
+ *@caller: caller
+ *@rgid: region ID of the shared region in the caller
+ *
+ * The region ID is left free, its address range is not reused. The last
+ * process leaving a shared region destroys it, its key can be published
+ * again.
+ */
+int __mm_shm_unmap(struct pcb_t* caller, int rgid)
+{
+  struct shm_seg_struct* seg;
+  struct shm_map_struct* map;
+  struct vm_rg_struct* rg;
+  int ret = -1;
+
+  lock_mm();
+  if ((map = __shm_map_of(caller, rgid, &seg)) != NULL)
+  {
+    __shm_detach(seg, map);
+    rg = get_symrg_byid(caller->mm, rgid);
+    rg->rg_start = rg->rg_end = 0;
+    ret = 0;
+  }
+  unlock_mm();
+
+#ifdef VMDBG
+  if (ret == 0)
+    printf("PID=%d shm region=%d detach\n", caller->pid, rgid);
+#endif
+  return ret;
+}
+
+/*__shm_exit - leave every shared region of an exiting process
+ *@caller: caller
+ *
+ * Its page references go with its page table, mmvm_lock must be held
+ */
+static void __shm_exit(struct pcb_t* caller)
+{
+  struct shm_map_struct *map, *next;
+  int i;
+
+  for (i = 0; i < SHM_MAX_SEGS; i++)
+    for (map = shm_segs[i].maps; map != NULL; map = next)
+    {
+      next = map->next;
+      if (map->proc == caller && __shm_unlink(&shm_segs[i], map))
+        __shm_destroy(caller, &shm_segs[i]);
+    }
+}
+
+/*__shm_fork - give a forked child the shared mappings of its parent
+ *@parent: forking process
+ *@child: new process
+ *
+ * The page references come with the copied page table, mmvm_lock must
+ * be held
+ */
+static void __shm_fork(struct pcb_t* parent, struct pcb_t* child)
+{
+  struct shm_map_struct *map, *newmap;
+  int i;
+
+  for (i = 0; i < SHM_MAX_SEGS; i++)
+    for (map = shm_segs[i].maps; map != NULL; map = map->next)
+    {
+      if (map->proc != parent)
+        continue;
+      /* Ahead of the walk, so the child is not visited */
+      if ((newmap = malloc(sizeof(struct shm_map_struct))) == NULL)
+        continue;
+      *newmap = *map;
+      newmap->proc = child;
+      newmap->next = shm_segs[i].maps;
+      shm_segs[i].maps = newmap;
+    }
+}
+
+/*free_pcb_memphy - collect all memphy of pcb
+ *@caller: caller
+ *
+ * Only the page ranges of the vm areas are walked, so the cost follows
+ * the size of the address space actually in use. Frames shared through
+ * fork or a shared region just lose one reference.
+ */
+int free_pcb_memph(struct pcb_t* caller)
+{
+  struct vm_area_struct* vma;
+  int pagenum, pgend;
+  uint32_t pte;
+
+  lock_mm();
+  __shm_exit(caller);
+  for (vma = caller->mm->mmap; vma != NULL; vma = vma->vm_next)
+  {
+    pgend = DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ);
+    for (pagenum = vma->vm_start / PAGING_PAGESZ; pagenum < pgend; pagenum++)
+    {
+      pte = caller->mm->pgd[pagenum];
+
+      if (!PAGING_PAGE_PRESENT(pte))
+        continue;
+
+      __pte_unref(caller, pte);
+      caller->mm->pgd[pagenum] = 0;
+    }
+  }
+  unlock_mm();
+  return 0;
+}
+
+/*free_pcb_mm - release the whole memory of an exiting process
+ *@caller: caller
+ *
+ * Return frames and swap slots first, then every mm metadata node
+ */
+int free_pcb_mm(struct pcb_t* caller)
+{
+  struct mm_struct* mm = caller->mm;
+  struct vm_area_struct* vma;
+  int i;
+
+  if (mm == NULL)
     return -1;
+
+  free_pcb_memph(caller);
+
+  while ((vma = mm->mmap) != NULL)
+  {
+    mm->mmap = vma->vm_next;
+    free(vma);
   }
-  //traverse to end of list
-  while (pg->pg_next)
+
+  /* Free regions and the page fifo all live in the mm pools */
+  objpool_release(&mm->rg_pool);
+  objpool_release(&mm->pgn_pool);
+
+  for (i = 0; i < mm->symrgtbl_npg; i++)
+    free(mm->symrgtbl[i]);
+  free(mm->symrgtbl);
+
+  free(mm->pgd);
+  free(mm);
+  caller->mm = NULL;
+  return 0;
+}
+
+
+/*__mm_fork - share the address space of a process copy-on-write
+ *@parent: forking process
+ *@child: new process, child->mm must be allocated
+ *
+ * Online pages keep their frame in both mm, write protected and with one
+ * more frame reference, swapped pages share their swap slot. Nothing is
+ * copied until the first pg_setval on a page.
+ */
+int __mm_fork(struct pcb_t* parent, struct pcb_t* child)
+{
+  struct mm_struct* pmm = parent->mm;
+  struct mm_struct* cmm = child->mm;
+  struct vm_area_struct *vma, *newvma;
+  struct vm_rg_struct *rg, **rgtail;
+  struct pgn_t *pg, **pgtail;
+  int pgn, pgend;
+  uint32_t pte;
+
+  objpool_init(&cmm->pgn_pool, sizeof(struct pgn_t));
+  objpool_init(&cmm->rg_pool, sizeof(struct vm_rg_struct));
+
+  cmm->pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
+  if (cmm->pgd == NULL)
+    return -1;
+
+  lock_mm();
+  cmm->mmap = NULL;
+  cmm->vma_cnt = 0;
+  memset(cmm->vma_byid, 0, sizeof(cmm->vma_byid));
+  for (vma = pmm->mmap; vma != NULL; vma = vma->vm_next)
   {
-    prev_pg = pg;
-    pg = pg->pg_next;
+    newvma = malloc(sizeof(struct vm_area_struct));
+    *newvma = *vma;
+
+    newvma->vm_freerg_list = NULL;
+    rgtail = &newvma->vm_freerg_list;
+    for (rg = vma->vm_freerg_list; rg != NULL; rg = rg->rg_next)
+    {
+      *rgtail = init_vm_rg(cmm, rg->rg_start, rg->rg_end);
+      rgtail = &(*rgtail)->rg_next;
+    }
+
+    insert_vm_area(cmm, newvma);
+
+    /* PAGING_PGN would wrap an empty stack area at its top to page 0 */
+    pgend = DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ);
+    for (pgn = vma->vm_start / PAGING_PAGESZ; pgn < pgend; pgn++)
+    {
+      pte = pmm->pgd[pgn];
+      if (!PAGING_PAGE_PRESENT(pte))
+        continue;
+
+      /* Shared regions stay shared across fork */
+      __pte_ref(parent, pte);
+      if (!PAGING_PAGE_SWAPPED(pte) && !(pte & PAGING_PTE_SHM_MASK))
+        SETBIT(pmm->pgd[pgn], PAGING_PTE_COW_MASK);
+      cmm->pgd[pgn] = pmm->pgd[pgn];
+    }
   }
 
-  /* TODO: Implement the theorical mechanism to find the victim page */
-  // FIFO so the retrieved page is the last one
-  *retpgn = pg->pgn;
-  //remove last page
-  if (prev_pg) prev_pg->pg_next = NULL;
-  else mm->fifo_pgn = NULL;
+  /* Same replacement order as the parent */
+  cmm->fifo_pgn = NULL;
+  pgtail = &cmm->fifo_pgn;
+  for (pg = pmm->fifo_pgn; pg != NULL; pg = pg->pg_next)
+  {
+    *pgtail = objpool_get(&cmm->pgn_pool);
+    (*pgtail)->pgn = pg->pgn;
+    (*pgtail)->pg_next = NULL;
+    pgtail = &(*pgtail)->pg_next;
+  }
+
+  cmm->symrgtbl = calloc(pmm->symrgtbl_npg, sizeof(struct vm_rg_struct*));
+  cmm->symrgtbl_npg = pmm->symrgtbl_npg;
+  for (pgn = 0; pgn < pmm->symrgtbl_npg; pgn++)
+  {
+    if (pmm->symrgtbl[pgn] == NULL)
+      continue;
+    cmm->symrgtbl[pgn] = malloc(PAGING_SYMTBL_PGSZ * sizeof(struct vm_rg_struct));
+    memcpy(cmm->symrgtbl[pgn], pmm->symrgtbl[pgn],
+           PAGING_SYMTBL_PGSZ * sizeof(struct vm_rg_struct));
+  }
+
+  cmm->ra_win = 0;
+  cmm->ra_lastpgn = -1;
+  cmm->ra_faults = cmm->ra_issued = cmm->ra_hits = cmm->ra_wasted = 0;
+  __shm_fork(parent, child);
   unlock_mm();
   return 0;
 }
 
 
+/*find_victim_page - find victim page
+ *@caller: caller
+ *@pgn: return page number
+ *
+ */
+int find_victim_page(struct mm_struct* mm, int* retpgn)
+{
+  int ret;
+
+  lock_mm();
+  ret = __find_victim_page(mm, retpgn);
+  unlock_mm();
+  return ret;
+}
+
+
 /*get_free_vmrg_area - get a free vm region
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -503,6 +1786,12 @@ int get_free_vmrg_area(struct pcb_t* caller, int vmaid, int size, struct vm_rg_s
   lock_mm();
   struct vm_area_struct* cur_vma = get_vma_by_num(caller->mm, vmaid);
 
+  if (cur_vma == NULL)
+  {
+    unlock_mm();
+    return -1;
+  }
+
   struct vm_rg_struct* rgit = cur_vma->vm_freerg_list;
 
   if (rgit == NULL)
@@ -1,17 +1,39 @@
 
 #include "loader.h"
+#include "libmem.h"
+#include "cpu.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 static uint32_t avail_pid = 1;
 
+/* Loader and fork may hand out PIDs concurrently */
+uint32_t alloc_pid(void) {
+	return __sync_fetch_and_add(&avail_pid, 1);
+}
+
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
 #define OPT_FREE	"free"
 #define OPT_READ	"read"
 #define OPT_WRITE	"write"
 #define OPT_SYSCALL	"syscall"
+#define OPT_JMP		"jmp"
+#define OPT_JZ		"jz"
+#define OPT_JNZ		"jnz"
+#define OPT_LOOP	"loop"
+#define OPT_SET		"set"
+#define OPT_COPY	"copy"
+#define OPT_FILL	"fill"
+#define OPT_LOAD	"load"
+
+#define OPT_NONE	((enum ins_opcode_t)-1)
 
 static enum ins_opcode_t get_opcode(char * opt) {
 	if (!strcmp(opt, OPT_CALC)) {
@@ -26,80 +48,425 @@ static enum ins_opcode_t get_opcode(char * opt) {
 		return WRITE;
 	}else if (!strcmp(opt, OPT_SYSCALL)) {
 		return SYSCALL;
+	}else if (!strcmp(opt, OPT_JMP)) {
+		return JMP;
+	}else if (!strcmp(opt, OPT_JZ)) {
+		return JZ;
+	}else if (!strcmp(opt, OPT_JNZ)) {
+		return JNZ;
+	}else if (!strcmp(opt, OPT_LOOP)) {
+		return LOOP;
+	}else if (!strcmp(opt, OPT_SET)) {
+		return SET;
+	}else if (!strcmp(opt, OPT_COPY)) {
+		return COPY;
+	}else if (!strcmp(opt, OPT_FILL)) {
+		return FILL;
+	}else if (!strcmp(opt, OPT_LOAD)) {
+		return LOAD;
 	}else{
-		printf("get_opcode return Opcode: %s\n", opt);
-		exit(1);
+		return OPT_NONE;
 	}
 }
 
-struct pcb_t * load(const char * path) {
-	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
-	proc->page_table =
-		(struct page_table_t*)malloc(sizeof(struct page_table_t));
-	proc->bp = PAGE_SIZE;
-	proc->pc = 0;
+static struct code_seg_t * new_code(void) {
+	struct code_seg_t * code =
+		(struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	code->text = NULL;
+	code->ops = NULL;
+	code->size = 0;
+	code->refcnt = 1;
+	code->img = NULL;
+	code->img_len = 0;
+	return code;
+}
 
-	/* Read process code from file */
-	FILE * file;
-	if ((file = fopen(path, "r")) == NULL) {
-		printf("Cannot find process description at '%s'\n", path);
-		exit(1);		
-	}
-	snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
+void free_code(struct code_seg_t * code) {
+	if (code->img != NULL)
+		munmap(code->img, code->img_len);
+	else
+		free(code->text);
+	free(code->ops);
+	free(code);
+}
+
+/* Parse a text program, return NULL on a malformed one */
+static struct code_seg_t * parse_text(FILE * file, const char * path,
+		uint32_t * priority) {
+	struct code_seg_t * code = new_code();
 	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
-	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
-	);
-	uint32_t i = 0;
 	char buf[200];
-	for (i = 0; i < proc->code->size; i++) {
-		fscanf(file, "%s", opcode);
-		proc->code->text[i].opcode = get_opcode(opcode);
-		switch(proc->code->text[i].opcode) {
+	uint32_t i;
+
+	if (fscanf(file, "%u %u", priority, &code->size) != 2) {
+		printf("Missing program header in '%s'\n", path);
+		free_code(code);
+		return NULL;
+	}
+	code->text = (struct inst_t*)calloc(code->size, sizeof(struct inst_t));
+	for (i = 0; i < code->size; i++) {
+		if (fscanf(file, "%9s", opcode) != 1) {
+			printf("Program '%s' ends after %u of %u instructions\n",
+			       path, i, code->size);
+			free_code(code);
+			return NULL;
+		}
+		code->text[i].opcode = get_opcode(opcode);
+		switch(code->text[i].opcode) {
 		case CALC:
 			break;
 		case ALLOC:
-			fscanf(
-				file,
-				"%u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
+			/* Optional third argument selects the vm area */
+			fgets(buf, sizeof(buf), file);
+			sscanf(buf, "%u %u %u",
+			           &code->text[i].arg_0,
+			           &code->text[i].arg_1,
+			           &code->text[i].arg_2
 			);
 			break;
 		case FREE:
-			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
+		case JMP:
+			fscanf(file, "%u\n", &code->text[i].arg_0);
+			break;
+		case JZ:
+		case JNZ:
+		case LOOP:
+		case SET:
+			fscanf(file, "%u %u\n",
+			       &code->text[i].arg_0,
+			       &code->text[i].arg_1);
 			break;
 		case READ:
 		case WRITE:
+		case COPY:
+		case FILL:
+		case LOAD:
 			fscanf(
 				file,
 				"%u %u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1,
-				&proc->code->text[i].arg_2
+				&code->text[i].arg_0,
+				&code->text[i].arg_1,
+				&code->text[i].arg_2
 			);
 			break;	
 		case SYSCALL:
 			fgets(buf, sizeof(buf), file);
 			sscanf(buf, "%d%d%d%d",
-			           &proc->code->text[i].arg_0,
-			           &proc->code->text[i].arg_1,
-			           &proc->code->text[i].arg_2,
-			           &proc->code->text[i].arg_3
+			           &code->text[i].arg_0,
+			           &code->text[i].arg_1,
+			           &code->text[i].arg_2,
+			           &code->text[i].arg_3
 			);
 			break;
 		default:
-			printf("Opcode: %s\n", opcode);
-			exit(1);
+			printf("Unknown opcode '%s' at instruction %u of '%s'\n",
+			       opcode, i, path);
+			free_code(code);
+			return NULL;
+		}
+	}
+	return code;
+}
+
+/* Map a packed image, the text is used in place and never copied */
+static struct code_seg_t * map_image(int fd, size_t len, const char * path,
+		uint32_t * priority) {
+	struct prog_hdr * hdr;
+	struct code_seg_t * code;
+	void * img;
+
+	img = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (img == MAP_FAILED)
+		return NULL;
+
+	hdr = (struct prog_hdr *)img;
+	if (hdr->inst_sz != sizeof(struct inst_t) ||
+	    len < sizeof(struct prog_hdr) +
+	          (size_t)hdr->size * sizeof(struct inst_t)) {
+		printf("Corrupted program image '%s'\n", path);
+		munmap(img, len);
+		return NULL;
+	}
+
+	code = new_code();
+	code->img = img;
+	code->img_len = len;
+	code->text = (struct inst_t *)(hdr + 1);
+	code->size = hdr->size;
+	*priority = hdr->priority;
+	return code;
+}
+
+struct code_seg_t * load_code(const char * path, uint32_t * priority) {
+	struct code_seg_t * code;
+	struct stat st;
+	uint32_t magic = 0;
+	FILE * file;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		printf("Cannot find process description at '%s'\n", path);
+		return NULL;
+	}
+
+	/* Images are told apart from text programs by their magic */
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct prog_hdr) &&
+	    pread(fd, &magic, sizeof(magic), 0) == sizeof(magic) &&
+	    magic == PROG_MAGIC) {
+		code = map_image(fd, st.st_size, path, priority);
+		close(fd);
+	} else if ((file = fdopen(fd, "r")) != NULL) {
+		code = parse_text(file, path, priority);
+		fclose(file);
+	} else {
+		close(fd);
+		return NULL;
+	}
+
+	/* Handlers are resolved here once, not at every run() */
+	if (code != NULL && decode_code(code) != 0) {
+		free_code(code);
+		return NULL;
+	}
+	return code;
+}
+
+int save_code(const char * path, uint32_t priority,
+		const struct code_seg_t * code) {
+	struct prog_hdr hdr;
+	FILE * file;
+	int ret = 0;
+
+	if ((file = fopen(path, "wb")) == NULL)
+		return -1;
+
+	hdr.magic = PROG_MAGIC;
+	hdr.inst_sz = sizeof(struct inst_t);
+	hdr.priority = priority;
+	hdr.size = code->size;
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    fwrite(code->text, sizeof(struct inst_t), code->size, file)
+	            != code->size)
+		ret = -1;
+	if (fclose(file) != 0)
+		ret = -1;
+	return ret;
+}
+
+/* Program cache, one shared code segment per program file version.
+ * The cache holds a reference on each code segment it keeps. */
+#define PROG_CACHE_BUCKETS 64
+
+struct prog_cache_ent {
+	char * path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	uint32_t priority;
+	struct code_seg_t * code;
+	struct prog_cache_ent * next;
+};
+
+static struct prog_cache_ent * prog_cache[PROG_CACHE_BUCKETS];
+static pthread_mutex_t prog_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int prog_hash(const char * path) {
+	unsigned int h = 5381;
+
+	while (*path)
+		h = h * 33 + (unsigned char)*path++;
+	return h % PROG_CACHE_BUCKETS;
+}
+
+static void put_code(struct code_seg_t * code) {
+	if (__sync_sub_and_fetch(&code->refcnt, 1) == 0)
+		free_code(code);
+}
+
+/* Reference on the cached code of path when it is still current,
+ * prog_cache_lock held. A stale entry is dropped, running processes keep
+ * the old code alive */
+static struct code_seg_t * cache_lookup(const char * path,
+		const struct stat * st, uint32_t * priority) {
+	struct prog_cache_ent ** pent, * ent;
+
+	pent = &prog_cache[prog_hash(path)];
+	for (ent = *pent; ent != NULL; pent = &ent->next, ent = ent->next) {
+		if (strcmp(ent->path, path) != 0)
+			continue;
+		if (ent->dev == st->st_dev && ent->ino == st->st_ino &&
+		    ent->size == st->st_size &&
+		    ent->mtime.tv_sec == st->st_mtim.tv_sec &&
+		    ent->mtime.tv_nsec == st->st_mtim.tv_nsec) {
+			__sync_fetch_and_add(&ent->code->refcnt, 1);
+			*priority = ent->priority;
+			return ent->code;
+		}
+		*pent = ent->next;
+		put_code(ent->code);
+		free(ent->path);
+		free(ent);
+		break;
+	}
+	return NULL;
+}
+
+/* Get a reference on the code of path, parse it on a miss or when the
+ * file changed since it was cached. Parsing runs unlocked so the loader
+ * threads build different programs in parallel */
+static struct code_seg_t * get_code(const char * path, uint32_t * priority) {
+	struct prog_cache_ent * ent;
+	struct code_seg_t * code, * cached;
+	uint32_t cached_prio;
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		printf("Cannot find process description at '%s'\n", path);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&prog_cache_lock);
+	code = cache_lookup(path, &st, priority);
+	pthread_mutex_unlock(&prog_cache_lock);
+	if (code != NULL)
+		return code;
+
+	code = load_code(path, priority);
+	if (code == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&prog_cache_lock);
+	cached = cache_lookup(path, &st, &cached_prio);
+	if (cached == NULL) {
+		ent = (struct prog_cache_ent *)malloc(sizeof(*ent));
+		ent->path = strdup(path);
+		ent->dev = st.st_dev;
+		ent->ino = st.st_ino;
+		ent->size = st.st_size;
+		ent->mtime = st.st_mtim;
+		ent->priority = *priority;
+		ent->code = code;
+		__sync_fetch_and_add(&code->refcnt, 1); /* the cache reference */
+		ent->next = prog_cache[prog_hash(path)];
+		prog_cache[prog_hash(path)] = ent;
+	}
+	pthread_mutex_unlock(&prog_cache_lock);
+	if (cached != NULL) {
+		/* Another loader got there first, keep its copy */
+		put_code(code);
+		*priority = cached_prio;
+		code = cached;
+	}
+	return code;
+}
+
+/* Interned program paths, one string per distinct path for the whole
+ * run so PCBs and arrivals only carry a pointer */
+#define PATH_TABLE_BUCKETS 256
+
+struct path_ent {
+	struct path_ent * next;
+	char path[];
+};
+
+static struct path_ent * path_table[PATH_TABLE_BUCKETS];
+static pthread_mutex_t path_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char * intern_path(const char * path) {
+	unsigned int h = 5381;
+	struct path_ent * ent;
+	const char * c;
+
+	for (c = path; *c; c++)
+		h = h * 33 + (unsigned char)*c;
+	h %= PATH_TABLE_BUCKETS;
+
+	pthread_mutex_lock(&path_table_lock);
+	for (ent = path_table[h]; ent != NULL; ent = ent->next)
+		if (strcmp(ent->path, path) == 0)
+			break;
+	if (ent == NULL) {
+		ent = (struct path_ent *)malloc(sizeof(*ent) + strlen(path) + 1);
+		strcpy(ent->path, path);
+		ent->next = path_table[h];
+		path_table[h] = ent;
+	}
+	pthread_mutex_unlock(&path_table_lock);
+	return ent->path;
+}
+
+void flush_code_cache(void) {
+	struct prog_cache_ent * ent;
+	int i;
+
+	pthread_mutex_lock(&prog_cache_lock);
+	for (i = 0; i < PROG_CACHE_BUCKETS; i++) {
+		while ((ent = prog_cache[i]) != NULL) {
+			prog_cache[i] = ent->next;
+			put_code(ent->code);
+			free(ent->path);
+			free(ent);
 		}
 	}
+	pthread_mutex_unlock(&prog_cache_lock);
+
+	pthread_mutex_lock(&path_table_lock);
+	for (i = 0; i < PATH_TABLE_BUCKETS; i++) {
+		struct path_ent * pent;
+
+		while ((pent = path_table[i]) != NULL) {
+			path_table[i] = pent->next;
+			free(pent);
+		}
+	}
+	pthread_mutex_unlock(&path_table_lock);
+}
+
+struct pcb_t * load_pcb(const char * path) {
+	uint32_t priority = 0;
+	struct code_seg_t * code = get_code(path, &priority);
+
+	if (code == NULL)
+		return NULL;
+
+	/* Create new PCB for the new process */
+	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
+	proc->pid = 0;
+	proc->page_table =
+		(struct page_table_t*)malloc(sizeof(struct page_table_t));
+	proc->bp = PAGE_SIZE;
+	proc->pc = 0;
+	proc->path = intern_path(path);
+	proc->priority = priority;
+	proc->code = code;
+	proc->sc_stats = NULL;
+	proc->sc_ring = NULL;
+	proc->sleep_bucket = NULL;
+	proc->vruntime = 0;
+#ifdef MM_PAGING
+	proc->mm = NULL;
+#endif
 	return proc;
 }
 
+struct pcb_t * load(const char * path) {
+	struct pcb_t * proc = load_pcb(path);
+
+	if (proc != NULL)
+		proc->pid = alloc_pid();
+	return proc;
+}
 
+void unload(struct pcb_t * proc) {
+	/* The last process running a program releases its code */
+	put_code(proc->code);
+#ifdef MM_PAGING
+	free_pcb_mm(proc);
+#endif
+	free(proc->sc_stats);
+	free(proc->sc_ring);
+	free(proc->page_table);
+	free(proc);
+}
 
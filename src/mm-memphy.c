@@ -8,6 +8,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+
+/* Free lists and frame references are touched by every CPU thread */
+#define lock_fp()    do { pthread_mutex_lock(&memphy_lock); } while (0)
+#define unlock_fp()  do { pthread_mutex_unlock(&memphy_lock); } while (0)
+static pthread_mutex_t memphy_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
@@ -107,6 +113,114 @@ int MEMPHY_write(struct memphy_struct* mp, int addr, BYTE data)
    return 0;
 }
 
+/*
+ *  MEMPHY_copy - move a block inside a MEMPHY device
+ *  @mp: memphy struct
+ *  @src: source address
+ *  @dst: destination address
+ *  @len: number of bytes, the blocks may overlap
+ */
+int MEMPHY_copy(struct memphy_struct* mp, int src, int dst, int len)
+{
+   BYTE value;
+   int i;
+
+   if (mp == NULL || len < 0 || src < 0 || dst < 0 ||
+       src + len > mp->maxsz || dst + len > mp->maxsz)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      memmove(mp->storage + dst, mp->storage + src, len);
+      return 0;
+   }
+
+   /* Sequential access device, byte by byte in a safe direction */
+   for (i = 0; i < len; i++)
+   {
+      int k = (dst > src) ? len - 1 - i : i;
+
+      MEMPHY_read(mp, src + k, &value);
+      MEMPHY_write(mp, dst + k, value);
+   }
+   return 0;
+}
+
+/*
+ *  MEMPHY_read_block - read a block of a MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: start address
+ *  @buf: destination buffer
+ *  @len: number of bytes
+ */
+int MEMPHY_read_block(struct memphy_struct* mp, int addr, BYTE* buf, int len)
+{
+   int i;
+
+   if (mp == NULL || len < 0 || addr < 0 || addr + len > mp->maxsz)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      memcpy(buf, mp->storage + addr, len);
+      return 0;
+   }
+
+   for (i = 0; i < len; i++)
+      MEMPHY_read(mp, addr + i, &buf[i]);
+   return 0;
+}
+
+/*
+ *  MEMPHY_write_block - write a block of a MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: start address
+ *  @buf: source buffer
+ *  @len: number of bytes
+ */
+int MEMPHY_write_block(struct memphy_struct* mp, int addr, const BYTE* buf, int len)
+{
+   int i;
+
+   if (mp == NULL || len < 0 || addr < 0 || addr + len > mp->maxsz)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      memcpy(mp->storage + addr, buf, len);
+      return 0;
+   }
+
+   for (i = 0; i < len; i++)
+      MEMPHY_write(mp, addr + i, buf[i]);
+   return 0;
+}
+
+/*
+ *  MEMPHY_fill - set a block of a MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: start address
+ *  @value: byte value
+ *  @len: number of bytes
+ */
+int MEMPHY_fill(struct memphy_struct* mp, int addr, BYTE value, int len)
+{
+   int i;
+
+   if (mp == NULL || len < 0 || addr < 0 || addr + len > mp->maxsz)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      memset(mp->storage + addr, value, len);
+      return 0;
+   }
+
+   for (i = 0; i < len; i++)
+      MEMPHY_write(mp, addr + i, value);
+   return 0;
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
@@ -122,14 +236,15 @@ int MEMPHY_format(struct memphy_struct* mp, int pagesz)
       return -1;
 
    /* Init head of free framephy list */
-   fst = malloc(sizeof(struct framephy_struct));
+   fst = objpool_get(&mp->fp_pool);
    fst->fpn = iter;
+   fst->fp_next = NULL;
    mp->free_fp_list = fst;
 
    /* We have list with first element, fill in the rest num-1 element member*/
    for (iter = 1; iter < numfp; iter++)
    {
-      newfst = malloc(sizeof(struct framephy_struct));
+      newfst = objpool_get(&mp->fp_pool);
       newfst->fpn = iter;
       newfst->fp_next = NULL;
       fst->fp_next = newfst;
@@ -141,18 +256,22 @@ int MEMPHY_format(struct memphy_struct* mp, int pagesz)
 
 int MEMPHY_get_freefp(struct memphy_struct* mp, int* retfpn)
 {
+   lock_fp();
    struct framephy_struct* fp = mp->free_fp_list;
 
    if (fp == NULL)
+   {
+      unlock_fp();
       return -1;
+   }
 
    *retfpn = fp->fpn;
    mp->free_fp_list = fp->fp_next;
+   mp->fp_refcnt[fp->fpn] = 1;
 
-   /* MEMPHY is iteratively used up until its exhausted
-    * No garbage collector acting then it not been released
-    */
-   free(fp);
+   /* The node goes back to the device pool, still under the lock */
+   objpool_put(&mp->fp_pool, fp);
+   unlock_fp();
 
    return 0;
 }
@@ -176,17 +295,75 @@ int MEMPHY_dump(struct memphy_struct* mp)
 
 int MEMPHY_put_freefp(struct memphy_struct* mp, int fpn)
 {
+   struct framephy_struct* newnode;
+
+   lock_fp();
+   newnode = objpool_get(&mp->fp_pool);
    struct framephy_struct* fp = mp->free_fp_list;
-   struct framephy_struct* newnode = malloc(sizeof(struct framephy_struct));
 
    /* Create new node with value fpn */
    newnode->fpn = fpn;
    newnode->fp_next = fp;
    mp->free_fp_list = newnode;
+   mp->fp_refcnt[fpn] = 0;
+   unlock_fp();
 
    return 0;
 }
 
+/*
+ *  MEMPHY_ref_fp - take one more reference on a used frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ */
+int MEMPHY_ref_fp(struct memphy_struct* mp, int fpn)
+{
+   lock_fp();
+   mp->fp_refcnt[fpn]++;
+   unlock_fp();
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_unref_fp - drop a reference, the last one frees the frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *
+ *  Return the number of references left, -1 for a frame already free
+ */
+int MEMPHY_unref_fp(struct memphy_struct* mp, int fpn)
+{
+   int left;
+
+   lock_fp();
+   if (mp->fp_refcnt[fpn] <= 0)
+   {
+      /* Freeing it again would hand it out twice */
+      unlock_fp();
+      printf("MEMPHY: unref of free frame %d\n", fpn);
+      return -1;
+   }
+   left = --mp->fp_refcnt[fpn];
+   unlock_fp();
+
+   if (left == 0)
+      MEMPHY_put_freefp(mp, fpn);
+
+   return left;
+}
+
+int MEMPHY_fp_refcnt(struct memphy_struct* mp, int fpn)
+{
+   int refcnt;
+
+   lock_fp();
+   refcnt = mp->fp_refcnt[fpn];
+   unlock_fp();
+
+   return refcnt;
+}
+
 /*
  *  Init MEMPHY struct
  */
@@ -196,6 +373,9 @@ int init_memphy(struct memphy_struct* mp, int max_size, int randomflg)
    mp->maxsz = max_size;
    memset(mp->storage, 0, max_size * sizeof(BYTE));
 
+   mp->fp_refcnt = calloc(max_size / PAGING_PAGESZ + 1, sizeof(int));
+   objpool_init(&mp->fp_pool, sizeof(struct framephy_struct));
+
    MEMPHY_format(mp, PAGING_PAGESZ);
 
    mp->rdmflg = (randomflg != 0) ? 1 : 0;
@@ -18,23 +18,75 @@
  */
 struct vm_area_struct* get_vma_by_num(struct mm_struct* mm, int vmaid)
 {
-  struct vm_area_struct* pvma = mm->mmap;
-
-  if (mm->mmap == NULL)
+  if (mm == NULL || vmaid < 0 || vmaid >= PAGING_MAX_VMA)
     return NULL;
 
-  int vmait = pvma->vm_id;
+  return mm->vma_byid[vmaid];
+}
 
-  while (vmait < vmaid)
-  {
-    if (pvma == NULL)
-      return NULL;
+/*vma_sorted_lower - index of the first vm area ending after addr
+ *@mm: memory region
+ *@addr: virtual address
+ *
+ * vm areas never overlap, so ordering on vm_start also orders vm_end
+ */
+static int vma_sorted_lower(struct mm_struct* mm, unsigned long addr)
+{
+  int lo = 0, hi = mm->vma_cnt;
 
-    pvma = pvma->vm_next;
-    vmait = pvma->vm_id;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (mm->vma_sorted[mid]->vm_end <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  return lo;
+}
+
+/*get_vma_by_addr - get the vm area containing a virtual address
+ *@mm: memory region
+ *@addr: virtual address
+ *
+ */
+struct vm_area_struct* get_vma_by_addr(struct mm_struct* mm, unsigned long addr)
+{
+  int i = vma_sorted_lower(mm, addr);
+
+  if (i < mm->vma_cnt && mm->vma_sorted[i]->vm_start <= addr)
+    return mm->vma_sorted[i];
+  return NULL;
+}
+
+/*insert_vm_area - register a new vm area in the mm lookups
+ *@mm: memory region
+ *@vma: new vm area, its ID must be unused
+ *
+ */
+int insert_vm_area(struct mm_struct* mm, struct vm_area_struct* vma)
+{
+  struct vm_area_struct** pvma;
+  int i;
+
+  if (vma->vm_id >= PAGING_MAX_VMA || mm->vma_byid[vma->vm_id] != NULL)
+    return -1;
+
+  /* mmap list stays ordered by ID */
+  for (pvma = &mm->mmap; *pvma != NULL && (*pvma)->vm_id < vma->vm_id;
+       pvma = &(*pvma)->vm_next)
+    ;
+  vma->vm_next = *pvma;
+  *pvma = vma;
+  vma->vm_mm = mm;
+  mm->vma_byid[vma->vm_id] = vma;
 
-  return pvma;
+  for (i = mm->vma_cnt; i > 0 && mm->vma_sorted[i - 1]->vm_start > vma->vm_start; i--)
+    mm->vma_sorted[i] = mm->vma_sorted[i - 1];
+  mm->vma_sorted[i] = vma;
+  mm->vma_cnt++;
+
+  return 0;
 }
 
 int __mm_swap_page(struct pcb_t* caller, int vicfpn, int swpfpn)
@@ -43,6 +95,28 @@ int __mm_swap_page(struct pcb_t* caller, int vicfpn, int swpfpn)
   return 0;
 }
 
+/*__mm_swap_in_page - copy a swapped frame back to MEMRAM
+ *@caller: caller
+ *@swpfpn: source frame in the active MEMSWP
+ *@tgtfpn: destination frame in MEMRAM
+ */
+int __mm_swap_in_page(struct pcb_t* caller, int swpfpn, int tgtfpn)
+{
+  __swap_cp_page(caller->active_mswp, swpfpn, caller->mram, tgtfpn);
+  return 0;
+}
+
+/*__mm_cow_page - duplicate a shared MEMRAM frame for its writer
+ *@caller: caller
+ *@srcfpn: shared frame
+ *@dstfpn: private frame of the writer
+ */
+int __mm_cow_page(struct pcb_t* caller, int srcfpn, int dstfpn)
+{
+  __swap_cp_page(caller->mram, srcfpn, caller->mram, dstfpn);
+  return 0;
+}
+
 /*get_vm_area_node - get vm area for a number of pages
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -54,7 +128,6 @@ int __mm_swap_page(struct pcb_t* caller, int vicfpn, int swpfpn)
 
 struct vm_rg_struct* get_vm_area_node_at_brk(struct pcb_t* caller, int vmaid, int size, int alignedsz)
 {
-  struct vm_rg_struct* newrg = malloc(sizeof(struct vm_rg_struct));;
   struct vm_area_struct* cur_vma = get_vma_by_num(caller->mm, vmaid);
   if (cur_vma == NULL)
   {
@@ -62,10 +135,13 @@ struct vm_rg_struct* get_vm_area_node_at_brk(struct pcb_t* caller, int vmaid, in
   }
 
   // Set the region boundaries based on the current break point
-  newrg->rg_start = cur_vma->sbrk;
-  newrg->rg_end = newrg->rg_start + alignedsz;
-  newrg->rg_next = NULL;
-  return newrg;
+  if (cur_vma->vm_flags & VM_GROWSDOWN)
+  {
+    if (cur_vma->sbrk < alignedsz)
+      return NULL;
+    return init_vm_rg(caller->mm, cur_vma->sbrk - alignedsz, cur_vma->sbrk);
+  }
+  return init_vm_rg(caller->mm, cur_vma->sbrk, cur_vma->sbrk + alignedsz);
 }
 
 /*validate_overlap_vm_area
@@ -78,21 +154,21 @@ struct vm_rg_struct* get_vm_area_node_at_brk(struct pcb_t* caller, int vmaid, in
  */
 int validate_overlap_vm_area(struct pcb_t* caller, int vmaid, int vmastart, int vmaend)
 {
-  struct vm_area_struct* vma = caller->mm->mmap;
+  struct mm_struct* mm = caller->mm;
+  int i;
+
+  if (vmastart >= vmaend)
+    return 0;
 
-  // Iterate through all VMAs to check for overlaps
-  while (vma != NULL)
+  /* Only areas from the first one ending after vmastart can collide */
+  for (i = vma_sorted_lower(mm, vmastart);
+       i < mm->vma_cnt && mm->vma_sorted[i]->vm_start < vmaend; i++)
   {
+    struct vm_area_struct* vma = mm->vma_sorted[i];
+
     // Skip checking against the same VMA we're validating
-    if (vma->vm_id != vmaid)
-    {
-      // Check if a proposed region overlaps with existing VMA
-      if (OVERLAP(vma->vm_start, vma->vm_end, vmastart, vmaend))
-      {
-        return -1; // Overlap detected
-      }
-    }
-    vma = vma->vm_next;
+    if (vma->vm_id != vmaid && vma->vm_start < vma->vm_end)
+      return -1; // Overlap detected
   }
   return 0; // No overlap found
 }
@@ -114,31 +190,44 @@ int inc_vma_limit(struct pcb_t* caller, int vmaid, int inc_sz)
 
   if (!area || !cur_vma)
   {
-    free(area);
+    objpool_put(&caller->mm->rg_pool, area);
     printf("ERROR: Failed to get VM area node or current VMA\n"); //debug
     return -1;
   }
 
+  int old_start = cur_vma->vm_start;
   int old_end = cur_vma->vm_end; //old_sbrk here
 
   /*Validate overlap of obtained region */
   if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) < 0)
+  {
+    objpool_put(&caller->mm->rg_pool, area);
     return -1; /*Overlap and failed allocation */
+  }
 
   /* TODO: Obtain the new vm area based on vmaid */
-  cur_vma->vm_end = area->rg_end;
-  cur_vma->sbrk = area->rg_end;
+  if (cur_vma->vm_flags & VM_GROWSDOWN)
+  {
+    cur_vma->vm_start = area->rg_start;
+    cur_vma->sbrk = area->rg_start;
+  }
+  else
+  {
+    cur_vma->vm_end = area->rg_end;
+    cur_vma->sbrk = area->rg_end;
+  }
 
   if (vm_map_ram(caller, area->rg_start, area->rg_end,
-                 old_end, incnumpage, area) < 0)
+                 area->rg_start, incnumpage, area) < 0)
   {
+    cur_vma->vm_start = old_start;
     cur_vma->vm_end = old_end;
-    cur_vma->sbrk = old_end;
-    free(area);
+    cur_vma->sbrk = (cur_vma->vm_flags & VM_GROWSDOWN) ? old_start : old_end;
+    objpool_put(&caller->mm->rg_pool, area);
     printf("ERROR: Failed to map memory to RAM\n"); //debug
     return -1; /* Map the memory to MEMRAM */
   }
-  free(area);
+  objpool_put(&caller->mm->rg_pool, area);
   return 0;
 }
 
@@ -7,6 +7,20 @@
 #include "mm.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+/* Frame lists handed from alloc_pages_range to vmap_page_range never
+ * leave the CPU thread that built them */
+static __thread struct objpool fp_carrier_pool =
+   OBJPOOL_INITIALIZER(struct framephy_struct);
+
+/*
+ * mm_thread_exit - release the node pools of the calling thread
+ */
+void mm_thread_exit(void)
+{
+  objpool_release(&fp_carrier_pool);
+}
 
 /*
  * init_pte - Initialize PTE entry
@@ -76,6 +90,10 @@ int pte_set_fpn(uint32_t* pte, int fpn)
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
+  /* Drop the stale swap location, it shares bits with FPN and the soft bits */
+  CLRBIT(*pte, PAGING_PTE_SWPTYP_MASK);
+  CLRBIT(*pte, PAGING_PTE_SWPOFF_MASK);
+
   SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
 
   return 0;
@@ -91,7 +109,7 @@ int vmap_page_range(struct pcb_t* caller, // process call
                     struct vm_rg_struct* ret_rg) // return mapped region, the real mapped fp
 {
   // no guarantee all given pages are mapped
-  //struct framephy_struct *fpit;
+  struct framephy_struct *fpit;
   int pgit = 0;
   int pgn = PAGING_PGN(addr);
 
@@ -118,14 +136,16 @@ int vmap_page_range(struct pcb_t* caller, // process call
       return -1; // Return an error code
     }
     pte_set_fpn(&caller->mm->pgd[pgn + pgit], frames->fpn);
+    fpit = frames;
     frames = frames->fp_next;
+    objpool_put(&fp_carrier_pool, fpit); /* the pte owns the frame now */
+
+    /* Tracking for later page replacement activities (if needed)
+     * Enqueue new usage page */
+    enlist_pgn_node(caller->mm, &caller->mm->fifo_pgn, pgn + pgit);
     pgit++;
   }
 
-  /* Tracking for later page replacement activities (if needed)
-   * Enqueue new usage page */
-  enlist_pgn_node(&caller->mm->fifo_pgn, pgn + pgit);
-
   return 0;
 }
 
@@ -152,9 +172,11 @@ int alloc_pages_range(struct pcb_t* caller, int req_pgnum, struct framephy_struc
   {
     /* TODO: allocate the page
      */
-    if (MEMPHY_get_freefp(caller->mram, &fpn) == 0)
+    /* Out of free frames, push one of our own pages to MEMSWP */
+    if (MEMPHY_get_freefp(caller->mram, &fpn) == 0 ||
+        pg_reclaim_frame(caller, &fpn) == 0)
     {
-      newfp_str = (struct framephy_struct*)malloc(sizeof(struct framephy_struct));
+      newfp_str = objpool_get(&fp_carrier_pool);
       newfp_str->fpn = fpn;
 
       //push to head, this is LIFO
@@ -165,6 +187,15 @@ int alloc_pages_range(struct pcb_t* caller, int req_pgnum, struct framephy_struc
     {
       // TODO: ERROR CODE of obtaining somes but not enough frames
       printf("Error: Not enough free frames, allocated %d frames out of %d\n", pgit, req_pgnum);
+
+      /* Give back what we got so far, the caller maps nothing */
+      while (*frm_lst != NULL)
+      {
+        newfp_str = *frm_lst;
+        *frm_lst = newfp_str->fp_next;
+        MEMPHY_put_freefp(caller->mram, newfp_str->fpn);
+        objpool_put(&fp_carrier_pool, newfp_str);
+      }
       return -1;
     }
   }
@@ -243,39 +274,70 @@ int __swap_cp_page(struct memphy_struct* mpsrc, int srcfpn,
  * @mm:     self mm
  * @caller: mm owner
  */
+/*
+ * new_vm_area - create an empty vm area
+ * @vmaid : vm area ID
+ * @start : start (and end) address of the empty area
+ * @flags : VM_* flags
+ */
+static struct vm_area_struct* new_vm_area(int vmaid, unsigned long start, unsigned long flags)
+{
+  struct vm_area_struct* vma = malloc(sizeof(struct vm_area_struct));
+
+  vma->vm_id = vmaid;
+  vma->vm_start = start;
+  vma->vm_end = start;
+  vma->sbrk = start;
+  vma->vm_flags = flags;
+  vma->vm_freerg_list = NULL;
+  vma->vm_next = NULL;
+  vma->vm_mm = NULL;
+
+  return vma;
+}
+
 int init_mm(struct mm_struct* mm, struct pcb_t* caller)
 {
-  struct vm_area_struct* vma0 = malloc(sizeof(struct vm_area_struct));
+  struct vm_area_struct* vma0 = new_vm_area(PAGING_VMA_HEAP, 0, 0);
+
+  objpool_init(&mm->pgn_pool, sizeof(struct pgn_t));
+  objpool_init(&mm->rg_pool, sizeof(struct vm_rg_struct));
 
-  mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
+  mm->pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
   //  printf("Initialized pgd for process %d with %d entries\n", caller->pid, PAGING_MAX_PGN);
   /* By default the owner comes with at least one vma */
-  vma0->vm_id = 0;
-  vma0->vm_start = 0;
-  vma0->vm_end = vma0->vm_start;
-  vma0->sbrk = vma0->vm_start;
-  struct vm_rg_struct* first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
-  vma0->vm_freerg_list = NULL;
+  struct vm_rg_struct* first_rg = init_vm_rg(mm, vma0->vm_start, vma0->vm_end);
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
 
-  /* TODO update VMA0 next */
-  vma0->vm_next = NULL;
+  /* TODO: update mmap */
+  mm->mmap = NULL;
+  mm->vma_cnt = 0;
+  memset(mm->vma_byid, 0, sizeof(mm->vma_byid));
+  insert_vm_area(mm, vma0);
 
-  /* Point vma owner backward */
-  vma0->vm_mm = mm;
+  /* Stack on top of the address space, mapped regions in between */
+  insert_vm_area(mm, new_vm_area(PAGING_VMA_STACK, PAGING_STACK_TOP, VM_GROWSDOWN));
+  insert_vm_area(mm, new_vm_area(PAGING_VMA_MMAP, PAGING_MMAP_BASE, 0));
 
-  /* TODO: update mmap */
-  mm->mmap = vma0;
+  mm->fifo_pgn = NULL;
+  mm->symrgtbl = NULL;
+  mm->symrgtbl_npg = 0;
+
+  /* Readahead starts closed until a sequential stream shows up */
+  mm->ra_win = 0;
+  mm->ra_lastpgn = -1;
+  mm->ra_faults = mm->ra_issued = mm->ra_hits = mm->ra_wasted = 0;
 
   return 0;
 }
 
-struct vm_rg_struct* init_vm_rg(int rg_start, int rg_end)
+struct vm_rg_struct* init_vm_rg(struct mm_struct* mm, int rg_start, int rg_end)
 {
-  struct vm_rg_struct* rgnode = malloc(sizeof(struct vm_rg_struct));
+  struct vm_rg_struct* rgnode = objpool_get(&mm->rg_pool);
 
   rgnode->rg_start = rg_start;
   rgnode->rg_end = rg_end;
+  rgnode->vmaid = PAGING_VMA_HEAP;
   rgnode->rg_next = NULL;
 
   return rgnode;
@@ -289,9 +351,9 @@ int enlist_vm_rg_node(struct vm_rg_struct** rglist, struct vm_rg_struct* rgnode)
   return 0;
 }
 
-int enlist_pgn_node(struct pgn_t** plist, int pgn)
+int enlist_pgn_node(struct mm_struct* mm, struct pgn_t** plist, int pgn)
 {
-  struct pgn_t* pnode = malloc(sizeof(struct pgn_t));
+  struct pgn_t* pnode = objpool_get(&mm->pgn_pool);
 
   pnode->pgn = pgn;
   pnode->pg_next = *plist;
@@ -412,5 +474,19 @@ int print_pgtbl(struct pcb_t* caller, uint32_t start, uint32_t end)
   return 0;
 }
 
+int print_ra_stat(struct pcb_t* caller)
+{
+  struct mm_struct* mm = caller->mm;
+
+  if (mm->ra_faults == 0)
+    return 0;
+
+  printf("PID=%d readahead: faults=%lu issued=%lu hits=%lu wasted=%lu "
+         "accuracy=%lu%% window=%d\n",
+         caller->pid, mm->ra_faults, mm->ra_issued, mm->ra_hits, mm->ra_wasted,
+         mm->ra_issued ? mm->ra_hits * 100 / mm->ra_issued : 0, mm->ra_win);
+  return 0;
+}
+
 //#endif
 
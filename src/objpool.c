@@ -0,0 +1,118 @@
+/*
+ * Fixed size object pools for the small, hot nodes of the paging
+ * library (page lists, regions, frame nodes).
+ */
+
+#include "objpool.h"
+
+#include <stdlib.h>
+
+/*objpool_stride - object footprint inside a chunk
+ *@objsz: object size
+ *
+ * Small objects are rounded up to a power of two so that a cache line
+ * holds a whole number of them, larger ones to whole cache lines
+ */
+static size_t objpool_stride(size_t objsz)
+{
+  size_t stride = sizeof(void*);
+
+  if (objsz > OBJPOOL_CACHELINE)
+    return (objsz + OBJPOOL_CACHELINE - 1) & ~(size_t)(OBJPOOL_CACHELINE - 1);
+
+  while (stride < objsz)
+    stride <<= 1;
+  return stride;
+}
+
+/*objpool_init - set up an empty pool
+ *@pool: pool
+ *@objsz: size of the pooled objects
+ */
+void objpool_init(struct objpool *pool, size_t objsz)
+{
+  pool->objsz = objsz;
+  pool->stride = 0;
+  pool->chunks = NULL;
+  pool->free_list = NULL;
+  pool->bump = pool->bump_end = NULL;
+}
+
+/*objpool_grow - add a new chunk to the arena
+ *@pool: pool
+ *
+ * The first line of the chunk links the arena, objects follow it
+ */
+static int objpool_grow(struct objpool *pool)
+{
+  size_t chunksz = OBJPOOL_CHUNKSZ;
+  char *chunk;
+
+  if (pool->stride == 0)
+    pool->stride = objpool_stride(pool->objsz);
+  if (chunksz < OBJPOOL_CACHELINE + pool->stride)
+    chunksz = OBJPOOL_CACHELINE + pool->stride;
+
+  chunk = aligned_alloc(OBJPOOL_CACHELINE, chunksz);
+  if (chunk == NULL)
+    return -1;
+
+  *(void**)chunk = pool->chunks;
+  pool->chunks = chunk;
+  pool->bump = chunk + OBJPOOL_CACHELINE;
+  pool->bump_end = chunk + chunksz;
+  return 0;
+}
+
+/*objpool_get - take an object from the pool
+ *@pool: pool
+ *
+ * Recently released objects are reused first, they are still warm
+ */
+void *objpool_get(struct objpool *pool)
+{
+  void *obj = pool->free_list;
+
+  if (obj != NULL)
+  {
+    pool->free_list = *(void**)obj;
+    return obj;
+  }
+
+  if (pool->bump == NULL || (char*)pool->bump + pool->stride > (char*)pool->bump_end)
+    if (objpool_grow(pool) != 0)
+      return NULL;
+
+  obj = pool->bump;
+  pool->bump = (char*)pool->bump + pool->stride;
+  return obj;
+}
+
+/*objpool_put - give an object back to the pool
+ *@pool: pool the object was taken from
+ *@obj: object, may be NULL
+ */
+void objpool_put(struct objpool *pool, void *obj)
+{
+  if (obj == NULL)
+    return;
+
+  *(void**)obj = pool->free_list;
+  pool->free_list = obj;
+}
+
+/*objpool_release - free every object of the pool at once
+ *@pool: pool, left empty and ready for reuse
+ */
+void objpool_release(struct objpool *pool)
+{
+  void *chunk;
+
+  while ((chunk = pool->chunks) != NULL)
+  {
+    pool->chunks = *(void**)chunk;
+    free(chunk);
+  }
+  pool->free_list = NULL;
+  pool->bump = pool->bump_end = NULL;
+}
@@ -3,15 +3,24 @@
 #include "timer.h"
 #include "sched.h"
 #include "loader.h"
+#include "proctbl.h"
+#include "dev.h"
+#include "schedstat.h"
 #include "mm.h"
 
+#include <ctype.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+/* From syscall.h, whose syscall() clashes with the one of unistd.h */
+void syscall_stat_dump(void);
 
 static int time_slot;
 static int num_cpus;
+static int cpus_running;
 static int done = 0;
 
 #ifdef MM_PAGING
@@ -30,17 +39,73 @@ struct mmpaging_ld_args
 };
 #endif
 
-static struct ld_args
+/* One process arrival line of the config */
+struct ld_entry
 {
-	char** path;
-	unsigned long* start_time;
-#ifdef MLQ_SCHED
-	unsigned long* prio;
-#endif
-} ld_processes;
+	unsigned long start_time;
+	const char* path; /* interned, NULL past the last arrival */
+	unsigned long prio;
+};
+
+/* The config is read lazily, arrival lines stay in the file until
+ * ld_routine gets to them, so its size does not matter */
+static FILE* ld_file;
 
 int num_processes;
 
+/*
+ * Loader prefetch. ld_routine reads the arrivals up to LD_LOOKAHEAD
+ * entries ahead and LD_THREADS loaders build their PCB (parse, mm)
+ * before the start time. Entry i goes through ring slot i % LD_LOOKAHEAD,
+ * a loader waits on the slot condition until ld_routine has read the
+ * entry into it. A built PCB is handed back by the slot state alone,
+ * stored with release ordering once the PCB is complete. ld_routine
+ * only sleeps on the slot condition when the build is still running at
+ * the start time, and simulated time does not move on until it is done,
+ * so the schedule never depends on how fast the host parses.
+ */
+enum ld_state { LD_FREE, LD_READ, LD_BUILT };
+
+static struct ld_slot
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int seq; /* entry in the slot */
+	enum ld_state state;
+	struct ld_entry ent;
+	struct pcb_t* proc;
+} ld_ring[LD_LOOKAHEAD];
+
+static int ld_claimed;	/* next config entry to build */
+static int ld_end = -1; /* number of entries once the config is all read */
+
+/* Last slot ld_routine is done admitting in. A CPU starts a slot only
+ * once the arrivals of that slot are queued, so which thread the timer
+ * wakes first does not change the schedule */
+static long ld_slot = -1;
+static pthread_mutex_t ld_slot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ld_slot_cond = PTHREAD_COND_INITIALIZER;
+
+static void wait_arrivals(uint64_t now)
+{
+	pthread_mutex_lock(&ld_slot_lock);
+	while (!done && ld_slot < (long)now)
+		pthread_cond_wait(&ld_slot_cond, &ld_slot_lock);
+	pthread_mutex_unlock(&ld_slot_lock);
+}
+
+/* ld_routine is done with the current slot, or with all of them */
+static void ld_next_slot(struct timer_id_t* timer_id, int last)
+{
+	pthread_mutex_lock(&ld_slot_lock);
+	ld_slot = current_time();
+	done = last;
+	pthread_cond_broadcast(&ld_slot_cond);
+	pthread_mutex_unlock(&ld_slot_lock);
+	if (!last)
+		next_slot(timer_id);
+}
+
 struct cpu_args
 {
 	struct timer_id_t* timer_id;
@@ -54,27 +119,30 @@ static void* cpu_routine(void* args)
 	int id = ((struct cpu_args*)args)->id;
 	/* Check for new process in ready queue */
 	int time_left = 0;
+	unsigned long busy = 0;
 	struct pcb_t* proc = NULL;
 	while (1)
 	{
+		wait_arrivals(current_time());
+		wake_sleepers(current_time());
+
 		/* Check the status of current process */
 		if (proc == NULL)
 		{
 			/* No process is running, the we load new process from
 		 	* ready queue */
 			proc = get_proc();
-			if (proc == NULL)
-			{
-				next_slot(timer_id);
-				continue; /* First load failed. skip dummy load */
-			}
 		}
-		else if (proc->pc == proc->code->size)
+		else if (proc->pc == proc->code->size || proc_killed(proc))
 		{
-			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-			       id, proc->pid);
-			free(proc);
+			/* The porcess has finish it job, or was killed */
+			printf("\tCPU %d: Processed %2d has %s\n", id, proc->pid,
+			       proc_killed(proc) ? "been killed" : "finished");
+#ifdef MM_READAHEAD
+			print_ra_stat(proc);
+#endif
+			remove_proc(proc);
+			unload(proc);
 			proc = get_proc();
 			time_left = 0;
 		}
@@ -88,7 +156,7 @@ static void* cpu_routine(void* args)
 		}
 
 		/* Recheck process status after loading new process */
-		if (proc == NULL && done)
+		if (proc == NULL && done && blocked_procs() == 0)
 		{
 			/* No process to run, exit */
 			printf("\tCPU %d stopped\n", id);
@@ -98,68 +166,295 @@ static void* cpu_routine(void* args)
 		{
 			/* There may be new processes to run in
 			 * next time slots, just skip current slot */
+			if (done)
+				futex_reap_deadlocked();
 			next_slot(timer_id);
 			continue;
 		}
+		else if (proc_killed(proc))
+		{
+			/* Killed while waiting, reaped on the next round */
+			time_left = 0;
+			continue;
+		}
 		else if (time_left == 0)
 		{
 			printf("\tCPU %d: Dispatched process %2d\n",
 			       id, proc->pid);
-			time_left = time_slot;
+			time_left = sched_slice(proc, time_slot);
 		}
 
 		/* Run current process */
 		run(proc);
+		tick_proc(proc);
+		busy++;
 		time_left--;
+		if (proc->state == PROC_READY)
+		{
+			/* Yielded, the CPU goes to the next process */
+			printf("\tCPU %d: Process %2d yielded\n", id, proc->pid);
+			put_proc(proc);
+			proc = NULL;
+			time_left = 0;
+		}
+		else if (proc->state == PROC_BLOCKED && park_proc(proc))
+		{
+			printf("\tCPU %d: Process %2d blocked\n", id, proc->pid);
+			proc = NULL;
+			time_left = 0;
+		}
 		next_slot(timer_id);
 	}
+	schedstat_cpu(id, busy);
+	/* The last CPU out lets the devices go, nothing waits on them */
+	if (__atomic_sub_fetch(&cpus_running, 1, __ATOMIC_ACQ_REL) == 0)
+		dev_shutdown();
 	detach_event(timer_id);
+#ifdef MM_PAGING
+	mm_thread_exit();
+#endif
+	pthread_exit(NULL);
+}
+
+/* Parse the next arrival line, [start time] [program] [priority] */
+static int read_arrival(struct ld_entry* ent)
+{
+	static char* line;
+	static size_t linesz;
+	char buf[256];
+	char* name;
+	char* full;
+	int off, len;
+
+	while (getline(&line, &linesz, ld_file) >= 0)
+	{
+		if (sscanf(line, "%lu %n", &ent->start_time, &off) != 1)
+		{
+			if (line[strspn(line, " \t\r\n")] != '\0')
+				printf("Bad arrival line: %s", line);
+			continue;
+		}
+		name = line + off;
+		len = strcspn(name, " \t\r\n");
+		if (len == 0)
+			continue;
+		ent->prio = strtoul(name + len, NULL, 10);
+		name[len] = '\0';
+
+		full = buf;
+		if (len + sizeof("input/proc/") > sizeof(buf))
+			full = malloc(len + sizeof("input/proc/"));
+		sprintf(full, "input/proc/%s", name);
+		ent->path = intern_path(full);
+		if (full != buf)
+			free(full);
+		return 0;
+	}
+	free(line);
+	line = NULL;
+	return -1;
+}
+
+/* Wait for entry i in its slot, NULL past the last entry */
+static struct ld_slot* wait_arrival(int i)
+{
+	struct ld_slot* slot = &ld_ring[i % LD_LOOKAHEAD];
+
+	pthread_mutex_lock(&slot->lock);
+	while (slot->seq != i ||
+	       __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != LD_READ)
+	{
+		if (ld_end >= 0 && i >= ld_end)
+		{
+			pthread_mutex_unlock(&slot->lock);
+			return NULL;
+		}
+		pthread_cond_wait(&slot->cond, &slot->lock);
+	}
+	pthread_mutex_unlock(&slot->lock);
+	return slot;
+}
+
+static void* prefetch_routine(void* args)
+{
+#ifdef MM_PAGING
+	struct mmpaging_ld_args* ld_args = (struct mmpaging_ld_args*)args;
+#endif
+	struct ld_slot* slot;
+
+	while ((slot = wait_arrival(__atomic_fetch_add(&ld_claimed, 1,
+						       __ATOMIC_RELAXED))) != NULL)
+	{
+		/* The entry stays put until the PCB is handed over */
+		struct pcb_t* proc = load_pcb(slot->ent.path);
+
+		if (proc != NULL)
+		{
+#ifdef MLQ_SCHED
+			proc->prio = slot->ent.prio;
+#else
+			proc->prio = proc->priority < MAX_PRIO ?
+				     proc->priority : MAX_PRIO - 1;
+#endif
+#ifdef MM_PAGING
+			proc->mm = malloc(sizeof(struct mm_struct));
+			init_mm(proc->mm, proc);
+			proc->mram = ld_args->mram;
+			proc->mswp = ld_args->mswp;
+			proc->active_mswp = ld_args->active_mswp;
+#endif
+		}
+		slot->proc = proc;
+		__atomic_store_n(&slot->state, LD_BUILT, __ATOMIC_RELEASE);
+		/* Only for ld_routine asleep on a slow build */
+		pthread_mutex_lock(&slot->lock);
+		pthread_cond_broadcast(&slot->cond);
+		pthread_mutex_unlock(&slot->lock);
+	}
 	pthread_exit(NULL);
 }
 
+/* Read arrivals into the free slots, up to entry limit excluded.
+ * Return the number of entries read so far */
+static int read_ahead(int nread, int limit)
+{
+	struct ld_entry ent;
+	struct ld_slot* slot;
+	int i;
+
+	while (ld_end < 0 && nread < limit)
+	{
+		if (nread >= num_processes || read_arrival(&ent) != 0)
+		{
+			/* Loaders waiting past the end give up */
+			ld_end = nread;
+			for (i = 0; i < LD_LOOKAHEAD; i++)
+			{
+				pthread_mutex_lock(&ld_ring[i].lock);
+				pthread_cond_broadcast(&ld_ring[i].cond);
+				pthread_mutex_unlock(&ld_ring[i].lock);
+			}
+			break;
+		}
+		slot = &ld_ring[nread % LD_LOOKAHEAD];
+		pthread_mutex_lock(&slot->lock);
+		slot->seq = nread;
+		slot->ent = ent;
+		slot->proc = NULL;
+		__atomic_store_n(&slot->state, LD_READ, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&slot->cond);
+		pthread_mutex_unlock(&slot->lock);
+		nread++;
+	}
+	return nread;
+}
+
+/* Take the PCB of a slot, waiting for its build if need be */
+static struct pcb_t* take_built(struct ld_slot* slot)
+{
+	struct pcb_t* proc;
+
+	if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != LD_BUILT)
+	{
+		pthread_mutex_lock(&slot->lock);
+		while (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != LD_BUILT)
+			pthread_cond_wait(&slot->cond, &slot->lock);
+		pthread_mutex_unlock(&slot->lock);
+	}
+	proc = slot->proc;
+	__atomic_store_n(&slot->state, LD_FREE, __ATOMIC_RELEASE);
+	return proc;
+}
+
 static void* ld_routine(void* args)
 {
 #ifdef MM_PAGING
-	struct memphy_struct* mram = ((struct mmpaging_ld_args*)args)->mram;
-	struct memphy_struct** mswp = ((struct mmpaging_ld_args*)args)->mswp;
-	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args*)args)->active_mswp;
 	struct timer_id_t* timer_id = ((struct mmpaging_ld_args*)args)->timer_id;
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
+	int i = 0, nread = 0;
 	printf("ld_routine\n");
-	while (i < num_processes)
+	while ((nread = read_ahead(nread, i + LD_LOOKAHEAD)) > i)
 	{
-		struct pcb_t* proc = load(ld_processes.path[i]);
-#ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
-#endif
-		while (current_time() < ld_processes.start_time[i])
+		struct ld_slot* slot = &ld_ring[i % LD_LOOKAHEAD];
+		struct ld_entry ent = slot->ent;
+		struct pcb_t* proc;
+
+		while (current_time() < ent.start_time)
 		{
-			next_slot(timer_id);
+			ld_next_slot(timer_id, 0);
 		}
-#ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
-#endif
+		/* Normally built long ago, a slow build holds the slot */
+		proc = take_built(slot);
+		i++;
+
+		if (proc == NULL)
+		{
+			/* A broken program is skipped, not fatal */
+			printf("\tSkipped process at %s\n", ent.path);
+			continue;
+		}
+
+		/* PIDs follow the config order whichever loader built the PCB */
+		proc->pid = alloc_pid();
 		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-		       ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+		       ent.path, proc->pid, ent.prio);
 		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
-		next_slot(timer_id);
+		ld_next_slot(timer_id, 0);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	fclose(ld_file);
+	ld_next_slot(timer_id, 1);
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/* Optional directive lines after the header, up to the first arrival:
+ *   device [name] [latency min] [latency max] [bytes per slot]
+ *   report [path of the CSV or JSON scheduler report]
+ *   policy [mlq | rr | stride | cfs]
+ *   policy mlfq [boost period] [aging limit]
+ */
+static void read_directives(FILE* file)
+{
+	char* line = NULL;
+	size_t linesz = 0;
+	char* key;
+	long pos;
+
+	while ((pos = ftell(file)) >= 0 && getline(&line, &linesz, file) >= 0)
+	{
+		key = line + strspn(line, " \t");
+		if (isdigit((unsigned char)*key))
+		{
+			/* First arrival, left to the loaders */
+			fseek(file, pos, SEEK_SET);
+			break;
+		}
+		if (*key == '\0' || *key == '\n' || *key == '#')
+			continue;
+		if (strncmp(key, "device", 6) == 0 && isspace((unsigned char)key[6]))
+		{
+			if (dev_config(key + 6) != 0)
+				printf("Bad device directive: %s", key);
+		}
+		else if (strncmp(key, "report", 6) == 0 && isspace((unsigned char)key[6]))
+		{
+			if (schedstat_config(key + 6) != 0)
+				printf("Bad report directive: %s", key);
+		}
+		else if (strncmp(key, "policy", 6) == 0 && isspace((unsigned char)key[6]))
+		{
+			if (sched_select(key + 6) != 0)
+				printf("Bad policy directive: %s", key);
+		}
+		else
+			printf("Unknown directive: %s", key);
+	}
+	free(line);
+}
+
+/* Read the config header, arrival lines are streamed by the loaders */
 static void read_config(const char* path)
 {
 	FILE* file;
@@ -169,9 +464,6 @@ static void read_config(const char* path)
 		exit(1);
 	}
 	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
 #ifdef MM_PAGING
 	int sit;
 #ifdef MM_FIXED_MEMSZ
@@ -196,25 +488,8 @@ static void read_config(const char* path)
 	fscanf(file, "\n"); /* Final character */
 #endif
 #endif
-
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
-	int i;
-	for (i = 0; i < num_processes; i++)
-	{
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
-#ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
-#endif
-		strcat(ld_processes.path[i], proc);
-	}
+	read_directives(file);
+	ld_file = file;
 }
 
 int main(int argc, char* argv[])
@@ -225,16 +500,16 @@ int main(int argc, char* argv[])
 		printf("Usage: os [path to configure file]\n");
 		return 1;
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
-	strcat(path, argv[1]);
+	char* path = malloc(strlen(argv[1]) + sizeof("input/"));
+	sprintf(path, "input/%s", argv[1]);
 	read_config(path);
+	free(path);
 
 	pthread_t* cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args* args =
 		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
 	pthread_t ld;
+	pthread_t prefetch[LD_THREADS];
 
 	/* Init timer */
 	int i;
@@ -244,7 +519,9 @@ int main(int argc, char* argv[])
 		args[i].id = i;
 	}
 	struct timer_id_t* ld_event = attach_event();
+	dev_init();
 	start_timer();
+	dev_start();
 
 #ifdef MM_PAGING
 	/* Init all MEMPHY include 1 MEMRAM and n of MEMSWP */
@@ -273,13 +550,26 @@ int main(int argc, char* argv[])
 
 	/* Init scheduler */
 	init_scheduler();
+	schedstat_init(num_cpus);
+
+	for (i = 0; i < LD_LOOKAHEAD; i++)
+	{
+		pthread_mutex_init(&ld_ring[i].lock, NULL);
+		pthread_cond_init(&ld_ring[i].cond, NULL);
+		ld_ring[i].seq = -1;
+	}
 
 	/* Run CPU and loader */
 #ifdef MM_PAGING
+	for (i = 0; i < LD_THREADS; i++)
+		pthread_create(&prefetch[i], NULL, prefetch_routine, (void*)mm_ld_args);
 	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
 #else
+	for (i = 0; i < LD_THREADS; i++)
+		pthread_create(&prefetch[i], NULL, prefetch_routine, NULL);
 	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
 #endif
+	cpus_running = num_cpus;
 	for (i = 0; i < num_cpus; i++)
 	{
 		pthread_create(&cpu[i], NULL,
@@ -292,9 +582,18 @@ int main(int argc, char* argv[])
 		pthread_join(cpu[i], NULL);
 	}
 	pthread_join(ld, NULL);
+	for (i = 0; i < LD_THREADS; i++)
+		pthread_join(prefetch[i], NULL);
+	dev_stop();
 
 	/* Stop timer */
 	stop_timer();
+	syscall_stat_dump();
+	dev_stat_dump();
+	schedstat_report();
+	finish_scheduler();
+	proctbl_flush();
+	flush_code_cache();
 
 	return 0;
 }
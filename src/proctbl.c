@@ -0,0 +1,130 @@
+/*
+ * Process table, a hash of program names to the live processes running
+ * them, so that kill only visits its victims.
+ */
+
+#include "proctbl.h"
+#include "sched.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Processes running one program name, linked through the PCBs */
+struct proc_name_ent
+{
+	const char *name; /* into the interned path of the first process */
+	size_t len;
+	struct pcb_t *procs;
+	struct proc_name_ent *next;
+};
+
+static struct proc_name_ent *proctbl[PROCTBL_BUCKETS];
+static pthread_mutex_t proctbl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char *prog_name(const char *path)
+{
+	const char *base = strrchr(path, '/');
+
+	return base != NULL ? base + 1 : path;
+}
+
+/* FNV-1a of the first len bytes of name */
+static unsigned proc_name_hash(const char *name, size_t len)
+{
+	unsigned h = 2166136261u;
+
+	while (len-- > 0)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+	return h % PROCTBL_BUCKETS;
+}
+
+/* Entry of name, created on demand when add is set */
+static struct proc_name_ent *proctbl_lookup(const char *name, int add)
+{
+	size_t len = strlen(name);
+	struct proc_name_ent **slot = &proctbl[proc_name_hash(name, len)];
+	struct proc_name_ent *ent;
+
+	for (ent = *slot; ent != NULL; ent = ent->next)
+		if (ent->len == len && memcmp(ent->name, name, len) == 0)
+			return ent;
+	if (!add)
+		return NULL;
+
+	ent = malloc(sizeof(struct proc_name_ent));
+	ent->name = name;
+	ent->len = len;
+	ent->procs = NULL;
+	ent->next = *slot;
+	*slot = ent;
+	return ent;
+}
+
+void proctbl_add(struct pcb_t *proc)
+{
+	struct proc_name_ent *ent;
+
+	proc->killed = 0;
+	proc->name_prev = NULL;
+	pthread_mutex_lock(&proctbl_lock);
+	ent = proctbl_lookup(prog_name(proc->path), 1);
+	proc->name_next = ent->procs;
+	if (ent->procs != NULL)
+		ent->procs->name_prev = proc;
+	ent->procs = proc;
+	pthread_mutex_unlock(&proctbl_lock);
+}
+
+void proctbl_remove(struct pcb_t *proc)
+{
+	pthread_mutex_lock(&proctbl_lock);
+	if (proc->name_prev != NULL)
+		proc->name_prev->name_next = proc->name_next;
+	else
+		proctbl_lookup(prog_name(proc->path), 0)->procs = proc->name_next;
+	if (proc->name_next != NULL)
+		proc->name_next->name_prev = proc->name_prev;
+	proc->name_prev = proc->name_next = NULL;
+	pthread_mutex_unlock(&proctbl_lock);
+}
+
+int proctbl_kill(const char *name)
+{
+	struct proc_name_ent *ent;
+	struct pcb_t *proc;
+	int count = 0;
+
+	pthread_mutex_lock(&proctbl_lock);
+	ent = proctbl_lookup(name, 0);
+	for (proc = ent != NULL ? ent->procs : NULL; proc != NULL;
+	     proc = proc->name_next)
+		if (!__atomic_exchange_n(&proc->killed, 1, __ATOMIC_RELEASE))
+		{
+			/* Still in the table, so not reaped while this runs */
+			cancel_wait(proc);
+			count++;
+		}
+	pthread_mutex_unlock(&proctbl_lock);
+	return count;
+}
+
+int proc_killed(struct pcb_t *proc)
+{
+	return __atomic_load_n(&proc->killed, __ATOMIC_ACQUIRE);
+}
+
+void proctbl_flush(void)
+{
+	struct proc_name_ent *ent;
+	int i;
+
+	pthread_mutex_lock(&proctbl_lock);
+	for (i = 0; i < PROCTBL_BUCKETS; i++)
+		while ((ent = proctbl[i]) != NULL)
+		{
+			proctbl[i] = ent->next;
+			free(ent);
+		}
+	pthread_mutex_unlock(&proctbl_lock);
+}
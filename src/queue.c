@@ -1,8 +1,12 @@
-
 #include "queue.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+#define QUEUE_INIT_CAP 16
+
+/* i-th entry counted from the head */
+#define queue_at(q, i) ((q)->proc[((q)->head + (i)) % (q)->cap])
+
 int empty(struct queue_t* q)
 {
 	if (q == NULL)
@@ -10,17 +14,58 @@ int empty(struct queue_t* q)
 	return (q->size == 0);
 }
 
+/* Double the ring, entries are laid out again from index 0 */
+static int grow_queue(struct queue_t* q)
+{
+	int cap = q->cap ? 2 * q->cap : QUEUE_INIT_CAP;
+	struct pcb_t** proc = malloc(cap * sizeof(struct pcb_t*));
+
+	if (proc == NULL)
+		return -1;
+	for (int i = 0; i < q->size; i++)
+		proc[i] = queue_at(q, i);
+	free(q->proc);
+	q->proc = proc;
+	q->head = 0;
+	q->cap = cap;
+	return 0;
+}
+
 void enqueue(struct queue_t* q, struct pcb_t* proc)
 {
 	/* TODO: put a new process to queue [q] */
 	if (q == NULL)
 		return;
-	if (q->size == MAX_QUEUE_SIZE)
+	if (q->size == q->cap && grow_queue(q) != 0)
+	{
+		printf("Error: cannot grow queue, PID %d dropped\n", proc->pid);
 		return;
-	q->proc[q->size] = proc;
+	}
+	queue_at(q, q->size) = proc;
 	q->size++;
 }
 
+/* Remove the i-th entry, closing the gap from the nearer end */
+static struct pcb_t* queue_take(struct queue_t* q, int idx)
+{
+	struct pcb_t* proc = queue_at(q, idx);
+	int i;
+
+	if (idx < q->size / 2)
+	{
+		for (i = idx; i > 0; i--)
+			queue_at(q, i) = queue_at(q, i - 1);
+		q->head = (q->head + 1) % q->cap;
+	}
+	else
+	{
+		for (i = idx; i < q->size - 1; i++)
+			queue_at(q, i) = queue_at(q, i + 1);
+	}
+	q->size--;
+	return proc;
+}
+
 struct pcb_t* dequeue(struct queue_t* q)
 {
 	/* TODO: return a pcb whose prioprity is the highest
@@ -33,28 +78,57 @@ struct pcb_t* dequeue(struct queue_t* q)
 
 	// the higher the priority, the lower the value
 	int best_idx = 0;
-	for (int i = 1; i < q->size; i++)
-	{
 #ifdef MLQ_SCHED
-		// In MLQ mode, queue holds a single prio level => FIFO
-		// But still use prio for tie-breaking if mixed
-		if (q->proc[i]->prio < q->proc[best_idx]->prio)
-		{
-			best_idx = i;
-		}
+	// In MLQ mode, queue holds a single prio level => FIFO
 #else
+	for (int i = 1; i < q->size; i++)
+	{
 		// Non-MLQ: choose process with highest (default) priority
-		if (q->proc[i]->priority < q->proc[best_idx]->priority) {
+		if (queue_at(q, i)->priority < queue_at(q, best_idx)->priority) {
 			best_idx = i;
 		}
-#endif
 	}
-	struct pcb_t* proc = q->proc[best_idx];
-	//shift the rest of the queue
-	for (int i = best_idx; i < q->size - 1; i++)
+#endif
+	return queue_take(q, best_idx);
+}
+
+struct pcb_t* queue_peek(struct queue_t* q)
+{
+	if (q == NULL || q->size == 0)
+		return NULL;
+	return queue_at(q, 0);
+}
+
+struct pcb_t* dequeue_min(struct queue_t* q, uint64_t (*key)(const struct pcb_t*))
+{
+	int best_idx = 0;
+
+	if (q == NULL || q->size == 0)
+		return NULL;
+	for (int i = 1; i < q->size; i++)
+		if (key(queue_at(q, i)) < key(queue_at(q, best_idx)))
+			best_idx = i;
+	return queue_take(q, best_idx);
+}
+
+int remove_queue(struct queue_t* q, struct pcb_t* proc)
+{
+	if (q == NULL)
+		return -1;
+	for (int i = 0; i < q->size; i++)
 	{
-		q->proc[i] = q->proc[i + 1];
+		if (queue_at(q, i) == proc)
+		{
+			queue_take(q, i);
+			return 0;
+		}
 	}
-	q->proc[--q->size] = NULL;
-	return proc;
+	return -1;
+}
+
+void free_queue(struct queue_t* q)
+{
+	free(q->proc);
+	q->proc = NULL;
+	q->head = q->size = q->cap = 0;
 }
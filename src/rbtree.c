@@ -0,0 +1,246 @@
+
+#include "rbtree.h"
+
+static void rotate_left(struct rb_root* root, struct rb_node* x)
+{
+	struct rb_node* y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	y->parent = x->parent;
+	if (x->parent == NULL)
+		root->node = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	y->left = x;
+	x->parent = y;
+}
+
+static void rotate_right(struct rb_root* root, struct rb_node* x)
+{
+	struct rb_node* y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	y->parent = x->parent;
+	if (x->parent == NULL)
+		root->node = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+	y->right = x;
+	x->parent = y;
+}
+
+void rb_insert(struct rb_root* root, struct rb_node* node)
+{
+	struct rb_node* parent;
+	struct rb_node* gparent;
+	struct rb_node* uncle;
+
+	while ((parent = node->parent) != NULL && parent->red)
+	{
+		gparent = parent->parent;
+		if (parent == gparent->left)
+		{
+			uncle = gparent->right;
+			if (uncle != NULL && uncle->red)
+			{
+				parent->red = uncle->red = 0;
+				gparent->red = 1;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->right)
+			{
+				rotate_left(root, parent);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->red = 0;
+			gparent->red = 1;
+			rotate_right(root, gparent);
+		}
+		else
+		{
+			uncle = gparent->left;
+			if (uncle != NULL && uncle->red)
+			{
+				parent->red = uncle->red = 0;
+				gparent->red = 1;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->left)
+			{
+				rotate_right(root, parent);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->red = 0;
+			gparent->red = 1;
+			rotate_left(root, gparent);
+		}
+	}
+	root->node->red = 0;
+}
+
+/* Put v in the place of u, whose children are left to the caller */
+static void transplant(struct rb_root* root, struct rb_node* u,
+		struct rb_node* v)
+{
+	if (u->parent == NULL)
+		root->node = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+	if (v != NULL)
+		v->parent = u->parent;
+}
+
+#define is_red(n) ((n) != NULL && (n)->red)
+
+void rb_erase(struct rb_root* root, struct rb_node* node)
+{
+	struct rb_node* child;	// node moved into the removed position
+	struct rb_node* parent;	// parent of child, which may be NULL
+	struct rb_node* sibling;
+	int red = node->red;
+
+	if (node->left == NULL)
+	{
+		child = node->right;
+		parent = node->parent;
+		transplant(root, node, child);
+	}
+	else if (node->right == NULL)
+	{
+		child = node->left;
+		parent = node->parent;
+		transplant(root, node, child);
+	}
+	else
+	{
+		/* Replace node by its successor, which has no left child */
+		struct rb_node* succ = node->right;
+
+		while (succ->left != NULL)
+			succ = succ->left;
+		red = succ->red;
+		child = succ->right;
+		if (succ->parent == node)
+			parent = succ;
+		else
+		{
+			parent = succ->parent;
+			transplant(root, succ, child);
+			succ->right = node->right;
+			succ->right->parent = succ;
+		}
+		transplant(root, node, succ);
+		succ->left = node->left;
+		succ->left->parent = succ;
+		succ->red = node->red;
+	}
+	if (red)
+		return;
+
+	/* A black node went away, child carries an extra black */
+	while (child != root->node && !is_red(child))
+	{
+		if (child == parent->left)
+		{
+			sibling = parent->right;
+			if (sibling->red)
+			{
+				sibling->red = 0;
+				parent->red = 1;
+				rotate_left(root, parent);
+				sibling = parent->right;
+			}
+			if (!is_red(sibling->left) && !is_red(sibling->right))
+			{
+				sibling->red = 1;
+				child = parent;
+				parent = child->parent;
+				continue;
+			}
+			if (!is_red(sibling->right))
+			{
+				sibling->left->red = 0;
+				sibling->red = 1;
+				rotate_right(root, sibling);
+				sibling = parent->right;
+			}
+			sibling->red = parent->red;
+			parent->red = 0;
+			sibling->right->red = 0;
+			rotate_left(root, parent);
+		}
+		else
+		{
+			sibling = parent->left;
+			if (sibling->red)
+			{
+				sibling->red = 0;
+				parent->red = 1;
+				rotate_right(root, parent);
+				sibling = parent->left;
+			}
+			if (!is_red(sibling->left) && !is_red(sibling->right))
+			{
+				sibling->red = 1;
+				child = parent;
+				parent = child->parent;
+				continue;
+			}
+			if (!is_red(sibling->left))
+			{
+				sibling->right->red = 0;
+				sibling->red = 1;
+				rotate_left(root, sibling);
+				sibling = parent->left;
+			}
+			sibling->red = parent->red;
+			parent->red = 0;
+			sibling->left->red = 0;
+			rotate_right(root, parent);
+		}
+		child = root->node;
+	}
+	if (child != NULL)
+		child->red = 0;
+}
+
+struct rb_node* rb_first(const struct rb_root* root)
+{
+	struct rb_node* node = root->node;
+
+	if (node == NULL)
+		return NULL;
+	while (node->left != NULL)
+		node = node->left;
+	return node;
+}
+
+struct rb_node* rb_next(const struct rb_node* node)
+{
+	struct rb_node* parent;
+
+	if (node->right != NULL)
+	{
+		node = node->right;
+		while (node->left != NULL)
+			node = node->left;
+		return (struct rb_node*)node;
+	}
+	while ((parent = node->parent) != NULL && node == parent->right)
+		node = parent;
+	return parent;
+}
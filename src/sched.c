@@ -1,180 +1,340 @@
 
 #include "queue.h"
 #include "sched.h"
+#include "proctbl.h"
+#include "timer.h"
+#include "schedstat.h"
+#include "syscall.h"
+#include "dev.h"
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define lock_queue()  do { pthread_mutex_lock(&queue_lock); } while (0)
 #define unlock_queue()  do { pthread_mutex_unlock(&queue_lock); } while (0)
 
-static struct queue_t ready_queue;
-// static struct queue_t run_queue; //OBSOLETED
 static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
 static struct queue_t running_list;
 
+/* Sleepers due in the current round of SLEEP_WHEEL_SZ slots are hashed
+ * by wake up slot. Later ones wait in the round wheel, hashed by round,
+ * and move down when their round starts */
+static struct pcb_t* sleep_wheel[SLEEP_WHEEL_SZ];
+static struct pcb_t* round_wheel[SLEEP_WHEEL_SZ];
+static uint64_t wheel_now;
+static int nr_sleeping;
+static int nr_blocked;
 
-#ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
-static int slot[MAX_PRIO];
-static int curr_prio;
-static int curr_slot;
+static const struct sched_policy* const policies[] = {
+	&sched_mlq_policy,
+	&sched_rr_policy,
+	&sched_stride_policy,
+	&sched_cfs_policy,
+	&sched_mlfq_policy,
+};
 
-#endif
+static const struct sched_policy* policy = &sched_mlq_policy;
 
+int sched_select(const char* args)
+{
+	char name[16];
+	int len;
+
+	if (sscanf(args, "%15s%n", name, &len) != 1)
+		return -1;
+	args += len;
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+	{
+		if (strcmp(policies[i]->name, name) != 0)
+			continue;
+		if (policies[i]->config != NULL)
+		{
+			if (policies[i]->config(args) != 0)
+				return -1;
+		}
+		else if (args[strspn(args, " \t\n")] != '\0')
+			return -1;
+		policy = policies[i];
+		return 0;
+	}
+	return -1;
+}
+
+const char* sched_policy_name(void)
+{
+	return policy->name;
+}
 
 int queue_empty(void)
 {
+	int result;
+
 	lock_queue();
-#ifdef MLQ_SCHED
-	for (int i = 0; i < MAX_PRIO; i++)
-		if (!empty(&mlq_ready_queue[i]))
-		{
-			unlock_queue();
-			return 0;
-		}
-	unlock_queue();
-	return 1;
-#else
-	int result = empty(&ready_queue) && empty(&run_queue);
+	result = policy->empty();
 	unlock_queue();
 	return result;
-#endif
 }
 
 void init_scheduler(void)
 {
 	lock_queue();
-#ifdef MLQ_SCHED
-	for (int i = 0; i < MAX_PRIO; i++)
-	{
-		mlq_ready_queue[i].size = 0;
-		slot[i] = MAX_PRIO - i;
-	}
+	policy->init();
 	unlock_queue();
-	curr_prio = 0;
-	curr_slot = MAX_PRIO;
-#else
-	ready_queue.size = 0;
-	run_queue.size = 0;
-	unlock_queue();
-#endif
 	running_list.size = 0;
 }
 
-#ifdef MLQ_SCHED
-/*
- *  Stateful design for routine calling
- *  based on the priority and our MLQ policy
- *  We implement stateful here using transition technique
- *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO -
- * prio)
- */
-struct pcb_t* get_mlq_proc(void)
-{
-	struct pcb_t* proc = NULL;
-	/*TODO: get a process from PRIORITY [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
-	if (queue_empty())
-	{
-		return NULL;
-	}
+struct pcb_t* get_proc(void)
+{
+	struct pcb_t* proc;
+
 	lock_queue();
-	//if current priority still has time slots, use it
-	if (curr_slot > 0 && !empty(&mlq_ready_queue[curr_prio]))
-	{
-		proc = dequeue(&mlq_ready_queue[curr_prio]);
-		curr_slot--;
-		unlock_queue();
-		return proc;
-	}
-	//round-robin search for non-empty queue
-	for (int offset = 1; offset < MAX_PRIO; offset++)
+	proc = policy->pick_next();
+	unlock_queue();
+
+	if (proc != NULL)
 	{
-		int p = (curr_prio + offset) % MAX_PRIO;
-		if (!empty(&mlq_ready_queue[p]))
-		{
-			curr_prio = p;
-			curr_slot = slot[p] - 1;
-			proc = dequeue(&mlq_ready_queue[p]);
-			unlock_queue();
-			return proc;
-		}
+		uint64_t now = current_time();
+
+		proc->state = PROC_RUNNING;
+		proc->on_cpu = 1;
+		proc->stat.wait += now - proc->stat.ready_since;
+		if (proc->stat.first_run == PROC_STAT_NONE)
+			proc->stat.first_run = now;
 	}
-	//if no process found, reset to priority 0
-	curr_prio = 0;
-	curr_slot = slot[0] - 1;
-	proc = dequeue(&mlq_ready_queue[0]);
-	unlock_queue();
 	return proc;
 }
 
-void put_mlq_proc(struct pcb_t* proc)
+void put_proc(struct pcb_t* proc)
 {
+	/* Still on running_list since add_proc() */
+	proc->state = PROC_READY;
+	proc->on_cpu = 0;
+	proc->stat.ready_since = current_time();
 	lock_queue();
-	enqueue(&mlq_ready_queue[proc->prio], proc);
+	policy->requeue(proc);
 	unlock_queue();
 }
 
-void add_mlq_proc(struct pcb_t* proc)
+void add_proc(struct pcb_t* proc)
 {
+	proc->running_list = &running_list;
+	proc->state = PROC_READY;
+	proc->on_cpu = 0;
+	proc->stat.arrival = proc->stat.ready_since = current_time();
+	proc->stat.first_run = PROC_STAT_NONE;
+	proc->stat.wait = proc->stat.run = 0;
+	proctbl_add(proc);
 	lock_queue();
-	enqueue(&mlq_ready_queue[proc->prio], proc);
+	enqueue(&running_list, proc);
+	policy->enqueue(proc);
 	unlock_queue();
 }
 
-struct pcb_t* get_proc(void)
+int sched_slice(struct pcb_t* proc, int def)
 {
-	return get_mlq_proc();
+	int slice;
+
+	if (policy->slice == NULL)
+		return def;
+	lock_queue();
+	slice = policy->slice(proc);
+	unlock_queue();
+	return slice;
 }
 
-void put_proc(struct pcb_t* proc)
+void tick_proc(struct pcb_t* proc)
 {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = &running_list;
+	proc->stat.run++;
+	if (policy->on_tick == NULL)
+		return;
 	lock_queue();
-	enqueue(&running_list, proc);
+	policy->on_tick(proc);
 	unlock_queue();
-	put_mlq_proc(proc);
 }
 
-void add_proc(struct pcb_t* proc)
+void remove_proc(struct pcb_t* proc)
 {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = &running_list;
 	lock_queue();
-	enqueue(&running_list, proc);
+	remove_queue(&running_list, proc);
 	unlock_queue();
-	add_mlq_proc(proc);
+	proctbl_remove(proc);
+	proc->state = PROC_TERMINATED;
+	proc->stat.finish = current_time();
+	schedstat_exit(proc);
 }
-#else
-struct pcb_t *get_proc(void) {
-	struct pcb_t *proc = NULL;
-	/*TODO: get a process from [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
+
+void finish_scheduler(void)
+{
 	lock_queue();
-	if (empty(&ready_queue)) {
-		unlock_queue();
-		return NULL;
+	policy->fini();
+	free_queue(&running_list);
+	unlock_queue();
+}
+
+/* Back to its ready queue, queue_lock must be held */
+static void __unblock_proc(struct pcb_t* proc)
+{
+	nr_blocked--;
+	if (proc->on_cpu)
+	{
+		/* Woken before its CPU let it go, it just goes on */
+		proc->state = PROC_RUNNING;
+		return;
 	}
-	proc = dequeue(&ready_queue);
+	proc->state = PROC_READY;
+	proc->stat.ready_since = current_time();
+	policy->enqueue(proc);
+}
+
+void block_proc(struct pcb_t* proc)
+{
+	lock_queue();
+	proc->state = PROC_BLOCKED;
+	nr_blocked++;
 	unlock_queue();
-	return proc;
 }
 
-void put_proc(struct pcb_t *proc) {
+void unblock_proc(struct pcb_t* proc)
+{
+	lock_queue();
+	__unblock_proc(proc);
+	unlock_queue();
+}
+
+int park_proc(struct pcb_t* proc)
+{
+	int parked;
+
+	lock_queue();
+	parked = proc->state == PROC_BLOCKED;
+	if (parked)
+		proc->on_cpu = 0;
+	unlock_queue();
+	return parked;
+}
+
+int blocked_procs(void)
+{
+	int n;
+
+	lock_queue();
+	n = nr_blocked;
+	unlock_queue();
+	return n;
+}
+
+int all_blocked_on(int waiters)
+{
+	int all;
+
+	lock_queue();
+	all = nr_blocked == waiters && running_list.size == nr_blocked;
+	unlock_queue();
+	return all;
+}
+
+/* Hook proc on the wheel its wake up round calls for, queue_lock must
+ * be held. Too far for the round wheel, it goes to the last round and
+ * is hooked again from there */
+static void __sleep_hook(struct pcb_t* proc)
+{
+	uint64_t round = proc->wake_time / SLEEP_WHEEL_SZ;
+	uint64_t now_round = wheel_now / SLEEP_WHEEL_SZ;
+	struct pcb_t** bucket;
+
+	if (round == now_round)
+		bucket = &sleep_wheel[proc->wake_time % SLEEP_WHEEL_SZ];
+	else if (round - now_round < SLEEP_WHEEL_SZ)
+		bucket = &round_wheel[round % SLEEP_WHEEL_SZ];
+	else
+		bucket = &round_wheel[(now_round - 1) % SLEEP_WHEEL_SZ];
+	proc->wait_next = *bucket;
+	proc->sleep_bucket = bucket;
+	*bucket = proc;
+}
+
+void sleep_proc(struct pcb_t* proc)
+{
+	lock_queue();
+	proc->state = PROC_BLOCKED;
+	nr_blocked++;
+	/* With nobody asleep the wheel was left behind */
+	if (nr_sleeping == 0)
+		wheel_now = current_time();
+	if (proc->wake_time <= wheel_now)
+		proc->wake_time = wheel_now + 1;
+	__sleep_hook(proc);
+	nr_sleeping++;
+	unlock_queue();
+}
+
+/* Take proc off the sleep wheel, queue_lock must be held */
+static int __sleep_cancel(struct pcb_t* proc)
+{
+	struct pcb_t** pp;
+
+	if (proc->sleep_bucket == NULL)
+		return 0;
+	for (pp = proc->sleep_bucket; *pp != NULL; pp = &(*pp)->wait_next)
+		if (*pp == proc)
+		{
+			*pp = proc->wait_next;
+			proc->wait_next = NULL;
+			proc->sleep_bucket = NULL;
+			nr_sleeping--;
+			return 1;
+		}
+	return 0;
+}
+
+void cancel_wait(struct pcb_t* proc)
+{
+	int cancelled;
+
 	lock_queue();
-	enqueue(&run_queue, proc);
+	cancelled = proc->state == PROC_BLOCKED && __sleep_cancel(proc);
+	if (cancelled)
+		__unblock_proc(proc);
 	unlock_queue();
+	if (cancelled)
+		return;
+
+	/* Whoever unlinks it from its wait list owns the wake up */
+	if (futex_cancel(proc) || dev_cancel(proc))
+		unblock_proc(proc);
 }
 
-void add_proc(struct pcb_t *proc) {
+void wake_sleepers(uint64_t now)
+{
+	struct pcb_t** pp;
+	struct pcb_t* proc;
+
 	lock_queue();
-	enqueue(&ready_queue, proc);
+	/* Each slot is visited once and everybody in its bucket is due. A
+	 * sleeper moves down from the round wheel at most once per round
+	 * it is too far for, so a slot costs O(1) per process it touches */
+	while (nr_sleeping > 0 && wheel_now < now)
+	{
+		wheel_now++;
+		if (wheel_now % SLEEP_WHEEL_SZ == 0)
+		{
+			pp = &round_wheel[wheel_now / SLEEP_WHEEL_SZ % SLEEP_WHEEL_SZ];
+			while ((proc = *pp) != NULL)
+			{
+				*pp = proc->wait_next;
+				__sleep_hook(proc);
+			}
+		}
+		pp = &sleep_wheel[wheel_now % SLEEP_WHEEL_SZ];
+		while ((proc = *pp) != NULL)
+		{
+			*pp = proc->wait_next;
+			proc->wait_next = NULL;
+			proc->sleep_bucket = NULL;
+			nr_sleeping--;
+			__unblock_proc(proc);
+		}
+	}
 	unlock_queue();
 }
-#endif
@@ -0,0 +1,131 @@
+/*
+ * Fair policy after CFS. The virtual runtime of a process grows in
+ * inverse proportion to its weight for every slot it runs, and the
+ * ready processes sit in a red-black tree ordered by it, the leftmost
+ * one is dispatched next. The slice shares a target latency among the
+ * ready processes by weight. Woken processes are placed a little
+ * behind the minimum so that interactive ones get the CPU back quickly.
+ */
+
+#include "queue.h"
+#include "sched.h"
+
+#define CFS_VSLOT (1 << 20)	       /* vruntime of a slot at CFS_WEIGHT0 */
+#define CFS_WEIGHT0 (MAX_PRIO / 2)
+#define CFS_TARGET_LATENCY 12	       /* slots for every ready process to run */
+#define CFS_MIN_GRANULARITY 1	       /* shortest slice */
+#define CFS_SLEEPER_CREDIT ((uint64_t)CFS_TARGET_LATENCY * CFS_VSLOT / 2)
+
+static struct rb_root timeline;
+static struct rb_node* leftmost;	/* cached rb_first(&timeline) */
+static int nr_ready;
+static uint64_t load;			/* weight of the ready processes */
+static uint64_t min_vruntime;		/* monotonic, of the dispatched processes */
+
+static void timeline_insert(struct pcb_t* proc)
+{
+	struct rb_node** link = &timeline.node;
+	struct rb_node* parent = NULL;
+	int first = 1;
+
+	/* Equal keys go right, so ties are served in arrival order */
+	while (*link != NULL)
+	{
+		parent = *link;
+		if (proc->vruntime < rb_entry(parent, struct pcb_t, run_node)->vruntime)
+			link = &parent->left;
+		else
+		{
+			link = &parent->right;
+			first = 0;
+		}
+	}
+	rb_link(&proc->run_node, parent, link);
+	rb_insert(&timeline, &proc->run_node);
+	if (first)
+		leftmost = &proc->run_node;
+	nr_ready++;
+	load += sched_weight(proc);
+}
+
+static void cfs_init(void)
+{
+	timeline.node = NULL;
+	leftmost = NULL;
+	nr_ready = 0;
+	load = 0;
+	min_vruntime = 0;
+}
+
+static void cfs_fini(void)
+{
+	/* The processes are owned by the running list */
+	cfs_init();
+}
+
+static int cfs_empty(void)
+{
+	return leftmost == NULL;
+}
+
+static struct pcb_t* cfs_pick_next(void)
+{
+	struct pcb_t* proc;
+
+	if (leftmost == NULL)
+		return NULL;
+	proc = rb_entry(leftmost, struct pcb_t, run_node);
+	leftmost = rb_next(leftmost);
+	rb_erase(&timeline, &proc->run_node);
+	nr_ready--;
+	load -= sched_weight(proc);
+	if (proc->vruntime > min_vruntime)
+		min_vruntime = proc->vruntime;
+	return proc;
+}
+
+static void cfs_enqueue(struct pcb_t* proc)
+{
+	uint64_t floor = min_vruntime > CFS_SLEEPER_CREDIT ?
+			 min_vruntime - CFS_SLEEPER_CREDIT : 0;
+
+	if (proc->vruntime < floor)
+		proc->vruntime = floor;
+	proc->ready_queue = NULL;
+	timeline_insert(proc);
+}
+
+static void cfs_requeue(struct pcb_t* proc)
+{
+	timeline_insert(proc);
+}
+
+static void cfs_tick(struct pcb_t* proc)
+{
+	proc->vruntime += (uint64_t)CFS_VSLOT * CFS_WEIGHT0 / sched_weight(proc);
+}
+
+/* proc was just picked, so it is not counted in nr_ready or load */
+static int cfs_slice(struct pcb_t* proc)
+{
+	uint64_t weight = sched_weight(proc);
+	uint64_t period = CFS_TARGET_LATENCY;
+	uint64_t slice;
+
+	if ((uint64_t)(nr_ready + 1) * CFS_MIN_GRANULARITY > period)
+		period = (uint64_t)(nr_ready + 1) * CFS_MIN_GRANULARITY;
+	slice = period * weight / (load + weight);
+	return slice < CFS_MIN_GRANULARITY ? CFS_MIN_GRANULARITY : (int)slice;
+}
+
+const struct sched_policy sched_cfs_policy = {
+	.name = "cfs",
+	.init = cfs_init,
+	.fini = cfs_fini,
+	.empty = cfs_empty,
+	.pick_next = cfs_pick_next,
+	.enqueue = cfs_enqueue,
+	.requeue = cfs_requeue,
+	.on_tick = cfs_tick,
+	.slice = cfs_slice,
+};
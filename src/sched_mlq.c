@@ -0,0 +1,304 @@
+/*
+ * MLQ policy, one FIFO per priority level served round robin, level p
+ * getting MAX_PRIO - p dispatches in a row.
+ *
+ * MLFQ policy on the same levels, always serving the highest non empty
+ * one. A process starts at its prio level, moves down one level when it
+ * uses up its quantum and up one level when it blocks or yields before.
+ * Processes queued for longer than the aging limit move up, and every
+ * boost period all of them go back to their prio level. Those running
+ * or blocked at boost time go back when they are queued again.
+ */
+
+#include "queue.h"
+#include "sched.h"
+#include "timer.h"
+
+#include <stdio.h>
+
+static struct queue_t mlq_ready_queue[MAX_PRIO];
+static int slot[MAX_PRIO];
+static int curr_prio;
+static int curr_slot;
+
+static void mlq_init(void)
+{
+	for (int i = 0; i < MAX_PRIO; i++)
+	{
+		mlq_ready_queue[i].size = 0;
+		slot[i] = MAX_PRIO - i;
+	}
+	curr_prio = 0;
+	curr_slot = MAX_PRIO;
+}
+
+static void mlq_fini(void)
+{
+	for (int i = 0; i < MAX_PRIO; i++)
+		free_queue(&mlq_ready_queue[i]);
+}
+
+static int mlq_empty(void)
+{
+	for (int i = 0; i < MAX_PRIO; i++)
+		if (!empty(&mlq_ready_queue[i]))
+			return 0;
+	return 1;
+}
+
+/*
+ *  Stateful design for routine calling
+ *  based on the priority and our MLQ policy
+ *  We implement stateful here using transition technique
+ *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO -
+ * prio)
+ */
+static struct pcb_t* mlq_pick_next(void)
+{
+	if (mlq_empty())
+		return NULL;
+
+	//if current priority still has time slots, use it
+	if (curr_slot > 0 && !empty(&mlq_ready_queue[curr_prio]))
+	{
+		curr_slot--;
+		return dequeue(&mlq_ready_queue[curr_prio]);
+	}
+	//round-robin search for non-empty queue
+	for (int offset = 1; offset < MAX_PRIO; offset++)
+	{
+		int p = (curr_prio + offset) % MAX_PRIO;
+		if (!empty(&mlq_ready_queue[p]))
+		{
+			curr_prio = p;
+			curr_slot = slot[p] - 1;
+			return dequeue(&mlq_ready_queue[p]);
+		}
+	}
+	//if no process found, reset to priority 0
+	curr_prio = 0;
+	curr_slot = slot[0] - 1;
+	return dequeue(&mlq_ready_queue[0]);
+}
+
+static void mlq_enqueue(struct pcb_t* proc)
+{
+#ifdef MLQ_SCHED
+	proc->mlq_ready_queue = mlq_ready_queue;
+#endif
+	enqueue(&mlq_ready_queue[proc->prio], proc);
+}
+
+#define MLFQ_QUANTUM 2	     /* slots at the top levels */
+#define MLFQ_LEVEL_STEP 4    /* levels per extra quantum */
+#define MLFQ_BOOST 100	     /* default boost period, 0 disables it */
+#define MLFQ_AGE 20	     /* default aging limit, 0 disables it */
+
+#define MAP_WORDS ((MAX_PRIO + 63) / 64)
+
+static uint64_t ready_map[MAP_WORDS]; /* bit p set if level p is non empty */
+static uint64_t boost_period = MLFQ_BOOST;
+static uint64_t age_limit = MLFQ_AGE;
+static uint64_t next_boost;
+static uint64_t last_aged;
+static unsigned int boost_epoch; /* boosts done so far */
+
+#define mlfq_quantum(level) (MLFQ_QUANTUM * (1 + (level) / MLFQ_LEVEL_STEP))
+
+/* Queue proc at level, its quantum starts over */
+static void mlfq_push(struct pcb_t* proc, int level, uint64_t now)
+{
+	proc->mlfq_level = level;
+	proc->mlfq_used = 0;
+	proc->mlfq_since = now;
+	proc->mlfq_epoch = boost_epoch;
+	enqueue(&mlq_ready_queue[level], proc);
+	ready_map[level / 64] |= 1ULL << (level % 64);
+}
+
+static struct pcb_t* mlfq_pop(int level)
+{
+	struct pcb_t* proc = dequeue(&mlq_ready_queue[level]);
+
+	if (empty(&mlq_ready_queue[level]))
+		ready_map[level / 64] &= ~(1ULL << (level % 64));
+	return proc;
+}
+
+/* Highest non empty level at or below from, -1 if none */
+static int mlfq_next_level(int from)
+{
+	int w = from / 64;
+	uint64_t bits;
+
+	if (from >= MAX_PRIO)
+		return -1;
+	bits = ready_map[w] & (~0ULL << (from % 64));
+	while (bits == 0)
+	{
+		if (++w == MAP_WORDS)
+			return -1;
+		bits = ready_map[w];
+	}
+	return w * 64 + __builtin_ctzll(bits);
+}
+
+/* Everybody back to its prio level, queued processes keep their order.
+ * The others are off the queues, the new epoch tells mlfq_boosted() */
+static void mlfq_boost(uint64_t now)
+{
+	int level, n;
+
+	boost_epoch++;
+	for (level = mlfq_next_level(0); level >= 0;
+	     level = mlfq_next_level(level + 1))
+	{
+		/* Those moved down to this level are just queued again */
+		for (n = mlq_ready_queue[level].size; n > 0; n--)
+		{
+			struct pcb_t* proc = mlfq_pop(level);
+
+			mlfq_push(proc, proc->prio, now);
+		}
+	}
+}
+
+/* Levels are FIFO, so the processes waiting too long are at the heads */
+static void mlfq_age(uint64_t now)
+{
+	struct pcb_t* proc;
+	int level;
+
+	for (level = mlfq_next_level(1); level >= 0;
+	     level = mlfq_next_level(level + 1))
+	{
+		while ((proc = queue_peek(&mlq_ready_queue[level])) != NULL &&
+		       now - proc->mlfq_since >= age_limit)
+			mlfq_push(mlfq_pop(level), level - 1, now);
+	}
+}
+
+static void mlfq_init(void)
+{
+	mlq_init();
+	for (int i = 0; i < MAP_WORDS; i++)
+		ready_map[i] = 0;
+	next_boost = boost_period;
+	last_aged = 0;
+	boost_epoch = 0;
+}
+
+static int mlfq_empty(void)
+{
+	return mlfq_next_level(0) < 0;
+}
+
+static struct pcb_t* mlfq_pick_next(void)
+{
+	uint64_t now = current_time();
+	int level;
+
+	if (boost_period != 0 && now >= next_boost)
+	{
+		mlfq_boost(now);
+		next_boost = now + boost_period;
+	}
+	if (age_limit != 0 && now != last_aged)
+	{
+		mlfq_age(now);
+		last_aged = now;
+	}
+	level = mlfq_next_level(0);
+	return level < 0 ? NULL : mlfq_pop(level);
+}
+
+/* Running or blocked through a boost, it is owed its prio level */
+static int mlfq_boosted(struct pcb_t* proc)
+{
+	return proc->mlfq_epoch != boost_epoch;
+}
+
+/* Admitted or forked at the prio level, woken up one level higher */
+static void mlfq_enqueue(struct pcb_t* proc)
+{
+	int level = proc->prio;
+
+	if (proc->stat.run != 0 && !mlfq_boosted(proc) &&
+	    (level = proc->mlfq_level) > 0)
+		level--;
+#ifdef MLQ_SCHED
+	proc->mlq_ready_queue = mlq_ready_queue;
+#endif
+	mlfq_push(proc, level, current_time());
+}
+
+/* Down a level on a used up quantum, up one on a yield, back to the
+ * prio level after a boost */
+static void mlfq_requeue(struct pcb_t* proc)
+{
+	int level = proc->mlfq_level;
+
+	if (mlfq_boosted(proc))
+		level = proc->prio;
+	else if (proc->mlfq_used >= mlfq_quantum(level))
+	{
+		if (level < MAX_PRIO - 1)
+			level++;
+	}
+	else if (level > 0)
+		level--;
+	mlfq_push(proc, level, current_time());
+}
+
+static void mlfq_tick(struct pcb_t* proc)
+{
+	proc->mlfq_used++;
+}
+
+/* What is left of the quantum at the current level */
+static int mlfq_slice(struct pcb_t* proc)
+{
+	int left = mlfq_quantum(proc->mlfq_level) - proc->mlfq_used;
+
+	return left > 0 ? left : 1;
+}
+
+/* "policy mlfq [boost period] [aging limit]", in time slots */
+static int mlfq_config(const char* args)
+{
+	unsigned long boost, age;
+	char extra;
+	int n = sscanf(args, "%lu %lu %c", &boost, &age, &extra);
+
+	if (n == EOF)
+		return 0;
+	if (n == 0 || n > 2)
+		return -1;
+	boost_period = boost;
+	if (n == 2)
+		age_limit = age;
+	return 0;
+}
+
+const struct sched_policy sched_mlq_policy = {
+	.name = "mlq",
+	.init = mlq_init,
+	.fini = mlq_fini,
+	.empty = mlq_empty,
+	.pick_next = mlq_pick_next,
+	.enqueue = mlq_enqueue,
+	.requeue = mlq_enqueue,
+};
+
+const struct sched_policy sched_mlfq_policy = {
+	.name = "mlfq",
+	.init = mlfq_init,
+	.fini = mlq_fini,
+	.empty = mlfq_empty,
+	.pick_next = mlfq_pick_next,
+	.enqueue = mlfq_enqueue,
+	.requeue = mlfq_requeue,
+	.on_tick = mlfq_tick,
+	.slice = mlfq_slice,
+	.config = mlfq_config,
+};
@@ -0,0 +1,44 @@
+/*
+ * Round robin policy, a single FIFO whatever the priority.
+ */
+
+#include "queue.h"
+#include "sched.h"
+
+static struct queue_t ready_queue;
+
+static void rr_init(void)
+{
+	ready_queue.size = 0;
+}
+
+static void rr_fini(void)
+{
+	free_queue(&ready_queue);
+}
+
+static int rr_empty(void)
+{
+	return empty(&ready_queue);
+}
+
+static struct pcb_t* rr_pick_next(void)
+{
+	return dequeue(&ready_queue);
+}
+
+static void rr_enqueue(struct pcb_t* proc)
+{
+	proc->ready_queue = &ready_queue;
+	enqueue(&ready_queue, proc);
+}
+
+const struct sched_policy sched_rr_policy = {
+	.name = "rr",
+	.init = rr_init,
+	.fini = rr_fini,
+	.empty = rr_empty,
+	.pick_next = rr_pick_next,
+	.enqueue = rr_enqueue,
+	.requeue = rr_enqueue,
+};
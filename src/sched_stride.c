@@ -0,0 +1,73 @@
+/*
+ * Stride policy. A process holds sched_weight() tickets and its pass
+ * grows by STRIDE1 / tickets for every slot it runs, the lowest pass
+ * is dispatched next. CPU time ends up proportional to the tickets.
+ */
+
+#include "queue.h"
+#include "sched.h"
+
+#define STRIDE1 (1 << 20)
+
+static struct queue_t ready_queue;
+static uint64_t global_pass; /* pass of the last dispatched process */
+
+static uint64_t stride_key(const struct pcb_t* proc)
+{
+	return proc->vruntime;
+}
+
+static void stride_init(void)
+{
+	ready_queue.size = 0;
+	global_pass = 0;
+}
+
+static void stride_fini(void)
+{
+	free_queue(&ready_queue);
+}
+
+static int stride_empty(void)
+{
+	return empty(&ready_queue);
+}
+
+static struct pcb_t* stride_pick_next(void)
+{
+	struct pcb_t* proc = dequeue_min(&ready_queue, stride_key);
+
+	if (proc != NULL && proc->vruntime > global_pass)
+		global_pass = proc->vruntime;
+	return proc;
+}
+
+/* Newcomers and sleepers join at the current pass, without credit */
+static void stride_enqueue(struct pcb_t* proc)
+{
+	if (proc->vruntime < global_pass)
+		proc->vruntime = global_pass;
+	proc->ready_queue = &ready_queue;
+	enqueue(&ready_queue, proc);
+}
+
+static void stride_requeue(struct pcb_t* proc)
+{
+	enqueue(&ready_queue, proc);
+}
+
+static void stride_tick(struct pcb_t* proc)
+{
+	proc->vruntime += STRIDE1 / sched_weight(proc);
+}
+
+const struct sched_policy sched_stride_policy = {
+	.name = "stride",
+	.init = stride_init,
+	.fini = stride_fini,
+	.empty = stride_empty,
+	.pick_next = stride_pick_next,
+	.enqueue = stride_enqueue,
+	.requeue = stride_requeue,
+	.on_tick = stride_tick,
+};
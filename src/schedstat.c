@@ -0,0 +1,283 @@
+/*
+ * Scheduler latency and fairness instrumentation.
+ */
+
+#include "schedstat.h"
+#include "proctbl.h"
+#include "timer.h"
+#include "sched.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct proc_rec
+{
+	uint32_t pid;
+	uint32_t prio;
+	const char *name; /* interned */
+	struct proc_stat stat;
+};
+
+static struct proc_rec *recs;
+static int nr_recs, cap_recs;
+static pthread_mutex_t recs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long *cpu_busy;
+static uint64_t cpu_end; /* slot the last CPU stopped in */
+static int nr_cpus;
+static char *report_path;
+
+int schedstat_config(const char *args)
+{
+	char path[256];
+
+	if (sscanf(args, "%255s", path) != 1)
+		return -1;
+	free(report_path);
+	report_path = strdup(path);
+	return 0;
+}
+
+void schedstat_init(int num_cpus)
+{
+	nr_cpus = num_cpus;
+	cpu_busy = calloc(num_cpus, sizeof(unsigned long));
+}
+
+void schedstat_exit(struct pcb_t *proc)
+{
+	struct proc_rec *rec;
+
+	pthread_mutex_lock(&recs_lock);
+	if (nr_recs == cap_recs)
+	{
+		cap_recs = cap_recs ? cap_recs * 2 : 64;
+		recs = realloc(recs, cap_recs * sizeof(struct proc_rec));
+	}
+	rec = &recs[nr_recs++];
+	rec->pid = proc->pid;
+	rec->prio = proc->prio;
+	rec->name = prog_name(proc->path);
+	rec->stat = proc->stat;
+	pthread_mutex_unlock(&recs_lock);
+}
+
+void schedstat_cpu(int id, unsigned long busy)
+{
+	uint64_t now = current_time();
+
+	if (id >= 0 && id < nr_cpus)
+		cpu_busy[id] = busy;
+	/* The timer keeps going while the devices and loader wind down */
+	pthread_mutex_lock(&recs_lock);
+	if (now > cpu_end)
+		cpu_end = now;
+	pthread_mutex_unlock(&recs_lock);
+}
+
+/* Response counts from arrival, a never dispatched process (killed
+ * while ready) responds at its finish */
+static uint64_t rec_response(const struct proc_rec *rec)
+{
+	uint64_t first = rec->stat.first_run;
+
+	if (first == PROC_STAT_NONE)
+		first = rec->stat.finish;
+	return first - rec->stat.arrival;
+}
+
+static uint64_t rec_turnaround(const struct proc_rec *rec)
+{
+	return rec->stat.finish - rec->stat.arrival;
+}
+
+/* Jain index of the CPU share each process got while runnable,
+ * 1 when all got the same share, 1/n when one got it all */
+static double jain_index(void)
+{
+	double sum = 0, sumsq = 0, x;
+	int i, n = 0;
+
+	for (i = 0; i < nr_recs; i++)
+	{
+		uint64_t runnable = recs[i].stat.run + recs[i].stat.wait;
+
+		if (runnable == 0)
+			continue;
+		x = (double)recs[i].stat.run / runnable;
+		sum += x;
+		sumsq += x * x;
+		n++;
+	}
+	return (n == 0 || sumsq == 0) ? 1.0 : sum * sum / (n * sumsq);
+}
+
+static int rec_cmp_prio(const void *a, const void *b)
+{
+	const struct proc_rec *x = a, *y = b;
+
+	if (x->prio != y->prio)
+		return x->prio < y->prio ? -1 : 1;
+	return x->pid < y->pid ? -1 : x->pid > y->pid;
+}
+
+static void export_csv(FILE *f, uint64_t now, double jain)
+{
+	int i;
+
+	fprintf(f, "pid,name,prio,arrival,first_run,finish,turnaround,response,waiting,run\n");
+	for (i = 0; i < nr_recs; i++)
+	{
+		const struct proc_rec *r = &recs[i];
+
+		fprintf(f, "%u,%s,%u,%llu,%lld,%llu,%llu,%llu,%llu,%llu\n",
+			r->pid, r->name, r->prio,
+			(unsigned long long)r->stat.arrival,
+			r->stat.first_run == PROC_STAT_NONE ? -1LL :
+				(long long)r->stat.first_run,
+			(unsigned long long)r->stat.finish,
+			(unsigned long long)rec_turnaround(r),
+			(unsigned long long)rec_response(r),
+			(unsigned long long)r->stat.wait,
+			(unsigned long long)r->stat.run);
+	}
+	for (i = 0; i < nr_cpus; i++)
+		fprintf(f, "# cpu,%d,%lu,%llu\n", i, cpu_busy[i],
+			(unsigned long long)now);
+	fprintf(f, "# jain,%.4f\n", jain);
+	fprintf(f, "# policy,%s\n", sched_policy_name());
+}
+
+/* Quoted JSON string, names come from file paths and may hold anything */
+static void json_string(FILE *f, const char *str)
+{
+	const unsigned char *c;
+
+	fputc('"', f);
+	for (c = (const unsigned char *)str; *c != '\0'; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			fprintf(f, "\\%c", *c);
+		else if (*c == '\n')
+			fputs("\\n", f);
+		else if (*c == '\t')
+			fputs("\\t", f);
+		else if (*c < 0x20 || *c == 0x7f)
+			fprintf(f, "\\u%04x", *c);
+		else
+			fputc(*c, f);
+	}
+	fputc('"', f);
+}
+
+static void export_json(FILE *f, uint64_t now, double jain)
+{
+	int i;
+
+	fputs("{\n  \"policy\": ", f);
+	json_string(f, sched_policy_name());
+	fputs(",\n  \"processes\": [", f);
+	for (i = 0; i < nr_recs; i++)
+	{
+		const struct proc_rec *r = &recs[i];
+
+		fprintf(f, "%s\n    {\"pid\": %u, \"name\": ", i ? "," : "", r->pid);
+		json_string(f, r->name);
+		fprintf(f, ", \"prio\": %u, "
+			"\"arrival\": %llu, \"first_run\": %lld, \"finish\": %llu, "
+			"\"turnaround\": %llu, \"response\": %llu, \"waiting\": %llu, "
+			"\"run\": %llu}",
+			r->prio,
+			(unsigned long long)r->stat.arrival,
+			r->stat.first_run == PROC_STAT_NONE ? -1LL :
+				(long long)r->stat.first_run,
+			(unsigned long long)r->stat.finish,
+			(unsigned long long)rec_turnaround(r),
+			(unsigned long long)rec_response(r),
+			(unsigned long long)r->stat.wait,
+			(unsigned long long)r->stat.run);
+	}
+	fprintf(f, "\n  ],\n  \"cpus\": [");
+	for (i = 0; i < nr_cpus; i++)
+		fprintf(f, "%s\n    {\"id\": %d, \"busy\": %lu, \"slots\": %llu}",
+			i ? "," : "", i, cpu_busy[i], (unsigned long long)now);
+	fprintf(f, "\n  ],\n  \"jain\": %.4f\n}\n", jain);
+}
+
+void schedstat_report(void)
+{
+	uint64_t now = cpu_end;
+	double jain = jain_index();
+	int i, j;
+
+	qsort(recs, nr_recs, sizeof(struct proc_rec), rec_cmp_prio);
+
+	printf("Scheduler report, policy %s:\n", sched_policy_name());
+	printf("%5s %-12s %4s %8s %8s %8s %10s %8s %8s %8s\n", "pid", "name",
+	       "prio", "arrival", "first", "finish", "turnaround", "response",
+	       "waiting", "run");
+	for (i = 0; i < nr_recs; i++)
+	{
+		const struct proc_rec *r = &recs[i];
+
+		printf("%5u %-12s %4u %8llu %8lld %8llu %10llu %8llu %8llu %8llu\n",
+		       r->pid, r->name, r->prio,
+		       (unsigned long long)r->stat.arrival,
+		       r->stat.first_run == PROC_STAT_NONE ? -1LL :
+				(long long)r->stat.first_run,
+		       (unsigned long long)r->stat.finish,
+		       (unsigned long long)rec_turnaround(r),
+		       (unsigned long long)rec_response(r),
+		       (unsigned long long)r->stat.wait,
+		       (unsigned long long)r->stat.run);
+	}
+
+	/* Records are sorted by priority, one run per level */
+	printf("%4s %6s %14s %12s %12s\n", "prio", "procs", "avg_turnaround",
+	       "avg_response", "avg_waiting");
+	for (i = 0; i < nr_recs; i = j)
+	{
+		double tat = 0, resp = 0, wait = 0;
+
+		for (j = i; j < nr_recs && recs[j].prio == recs[i].prio; j++)
+		{
+			tat += rec_turnaround(&recs[j]);
+			resp += rec_response(&recs[j]);
+			wait += recs[j].stat.wait;
+		}
+		printf("%4u %6d %14.2f %12.2f %12.2f\n", recs[i].prio, j - i,
+		       tat / (j - i), resp / (j - i), wait / (j - i));
+	}
+
+	for (i = 0; i < nr_cpus; i++)
+		printf("CPU %d utilization: %lu/%llu slots (%.1f%%)\n", i,
+		       cpu_busy[i], (unsigned long long)now,
+		       now ? 100.0 * cpu_busy[i] / now : 0.0);
+	printf("Jain fairness index: %.4f\n", jain);
+
+	if (report_path != NULL)
+	{
+		FILE *f = fopen(report_path, "w");
+		size_t len = strlen(report_path);
+
+		if (f == NULL)
+			printf("Cannot write report to %s\n", report_path);
+		else
+		{
+			if (len > 5 && strcmp(report_path + len - 5, ".json") == 0)
+				export_json(f, now, jain);
+			else
+				export_csv(f, now, jain);
+			fclose(f);
+		}
+	}
+
+	free(recs);
+	recs = NULL;
+	nr_recs = cap_recs = 0;
+	free(cpu_busy);
+	free(report_path);
+	report_path = NULL;
+}
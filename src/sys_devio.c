@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "syscall.h"
+#include "dev.h"
+
+/*
+ * devread - fill a region from a device, blocking until it completes
+ * @regs->a1: device number
+ * @regs->a2: region ID, filled from offset 0
+ * @regs->a3: length in bytes
+ */
+int __sys_devread(struct pcb_t *caller, struct sc_regs *regs)
+{
+   return dev_submit(caller, regs->a1, 0, regs->a2, regs->a3);
+}
+
+/*
+ * devwrite - send a region to a device, blocking until it completes
+ * @regs->a1: device number
+ * @regs->a2: region ID, sent from offset 0
+ * @regs->a3: length in bytes
+ */
+int __sys_devwrite(struct pcb_t *caller, struct sc_regs *regs)
+{
+   return dev_submit(caller, regs->a1, 1, regs->a2, regs->a3);
+}
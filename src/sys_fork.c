@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "syscall.h"
+#include "sched.h"
+#include "loader.h"
+#include "mm.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * fork - duplicate the caller, the child resumes at the next instruction
+ * @regs->a1: register receiving the child PID in the parent and 0 in
+ *            the child, ignored when out of range
+ */
+int __sys_fork(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct pcb_t *child = malloc(sizeof(struct pcb_t));
+   uint32_t rd = regs->a1;
+
+   /* Same program, registers, pc, priority and memory devices */
+   memcpy(child, caller, sizeof(struct pcb_t));
+   child->pid = alloc_pid();
+   child->sc_stats = NULL;
+   child->sc_ring = NULL;
+   __sync_fetch_and_add(&child->code->refcnt, 1);
+   child->page_table = malloc(sizeof(struct page_table_t));
+   memcpy(child->page_table, caller->page_table, sizeof(struct page_table_t));
+
+#ifdef MM_PAGING
+   child->mm = malloc(sizeof(struct mm_struct));
+   if (__mm_fork(caller, child) != 0)
+   {
+      free(child->mm);
+      __sync_fetch_and_sub(&child->code->refcnt, 1);
+      free(child->page_table);
+      free(child);
+      return -1;
+   }
+#endif
+
+   if (rd < sizeof(caller->regs) / sizeof(caller->regs[0]))
+   {
+      caller->regs[rd] = child->pid;
+      child->regs[rd] = 0;
+   }
+
+   printf("PID=%d forked child PID=%d\n", caller->pid, child->pid);
+   add_proc(child);
+   return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "syscall.h"
+#include "sched.h"
+#include "mm.h"
+#include <pthread.h>
+#include <stdio.h>
+
+/*
+ * Futex waiters, hashed by the physical address of the byte they wait
+ * on, so that processes sharing the frame meet whatever their region.
+ * Each bucket is a FIFO linked through the PCBs.
+ */
+#define FUTEX_BUCKETS 64
+
+static struct pcb_t *futex_table[FUTEX_BUCKETS];
+static int futex_waiters;
+static pthread_mutex_t futex_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct pcb_t **futex_bucket(int key)
+{
+   return &futex_table[(unsigned)key % FUTEX_BUCKETS];
+}
+
+/*
+ * futex_wait - block while a byte of memory holds a value
+ * @regs->a1: region ID
+ * @regs->a2: offset in the region
+ * @regs->a3: expected value
+ *
+ * Return -1 right away if the byte already differs, or on a bad address
+ */
+int __sys_futex_wait(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct pcb_t **pp;
+   BYTE value;
+   int key;
+
+#ifdef MM_PAGING
+   key = __rg_paddr(caller, regs->a1, regs->a2);
+#else
+   key = -1;
+#endif
+   if (key < 0)
+      return -1;
+
+   /* The check and the queueing are one step for futex_wake */
+   pthread_mutex_lock(&futex_lock);
+   if (MEMPHY_read(caller->mram, key, &value) != 0 || value != (BYTE)regs->a3)
+   {
+      pthread_mutex_unlock(&futex_lock);
+      return -1;
+   }
+
+   for (pp = futex_bucket(key); *pp != NULL; pp = &(*pp)->wait_next)
+      ;
+   caller->wait_key = key;
+   caller->wait_next = NULL;
+   *pp = caller;
+   futex_waiters++;
+   block_proc(caller);
+   pthread_mutex_unlock(&futex_lock);
+   return 0;
+}
+
+/*
+ * futex_wake - wake up processes waiting on a byte of memory
+ * @regs->a1: region ID
+ * @regs->a2: offset in the region
+ * @regs->a3: most processes to wake up
+ *
+ * Return the number of processes woken up
+ */
+int __sys_futex_wake(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct pcb_t **pp;
+   struct pcb_t *proc;
+   uint32_t woken = 0;
+   int key;
+
+#ifdef MM_PAGING
+   key = __rg_paddr(caller, regs->a1, regs->a2);
+#else
+   key = -1;
+#endif
+   if (key < 0)
+      return -1;
+
+   pthread_mutex_lock(&futex_lock);
+   pp = futex_bucket(key);
+   while ((proc = *pp) != NULL && woken < regs->a3)
+   {
+      if (proc->wait_key != key)
+      {
+         pp = &proc->wait_next;
+         continue;
+      }
+      *pp = proc->wait_next;
+      proc->wait_next = NULL;
+      futex_waiters--;
+      unblock_proc(proc);
+      woken++;
+   }
+   pthread_mutex_unlock(&futex_lock);
+   return woken;
+}
+
+/*
+ * futex_cancel - drop a process from the futex wait lists
+ * @proc: process that may wait, its caller unblocks it
+ *
+ * Return 1 if it was waiting, 0 if it was woken up already
+ */
+int futex_cancel(struct pcb_t *proc)
+{
+   struct pcb_t **pp;
+   int found = 0;
+
+   pthread_mutex_lock(&futex_lock);
+   for (pp = futex_bucket(proc->wait_key); *pp != NULL; pp = &(*pp)->wait_next)
+      if (*pp == proc)
+      {
+         *pp = proc->wait_next;
+         proc->wait_next = NULL;
+         futex_waiters--;
+         found = 1;
+         break;
+      }
+   pthread_mutex_unlock(&futex_lock);
+   return found;
+}
+
+/*
+ * futex_reap_deadlocked - end the futex waiters nobody can wake up
+ *
+ * When every live process waits on a futex, none runs, is ready, sleeps
+ * or waits on a device, so no wake up can come once all arrivals are
+ * in. The waiters are reported, marked killed and unblocked for a CPU
+ * to reap them.
+ *
+ * Return the number of processes reaped
+ */
+int futex_reap_deadlocked(void)
+{
+   struct pcb_t *proc;
+   int reaped = 0;
+   int i;
+
+   pthread_mutex_lock(&futex_lock);
+   if (futex_waiters == 0 || !all_blocked_on(futex_waiters))
+   {
+      pthread_mutex_unlock(&futex_lock);
+      return 0;
+   }
+
+   for (i = 0; i < FUTEX_BUCKETS; i++)
+      while ((proc = futex_table[i]) != NULL)
+      {
+         futex_table[i] = proc->wait_next;
+         proc->wait_next = NULL;
+         printf("\tProcess %2d deadlocked on futex %d\n",
+                proc->pid, proc->wait_key);
+         __atomic_store_n(&proc->killed, 1, __ATOMIC_RELEASE);
+         unblock_proc(proc);
+         reaped++;
+      }
+   futex_waiters = 0;
+   pthread_mutex_unlock(&futex_lock);
+   return reaped;
+}
@@ -10,10 +10,34 @@
 
 #include "syscall.h"
 
+/*
+ * listsyscall - print the syscall table with the counters of each entry,
+ * for the caller and for the whole system, host times included when
+ * they are measured
+ */
 int __sys_listsyscall(struct pcb_t *caller, struct sc_regs* reg)
 {
+   int times = syscall_host_times();
+
    for (int i = 0; i < syscall_table_size; i++)
-       printf("%s\n",sys_call_table[i]); 
+   {
+      const struct sc_stat *own = syscall_stat(caller, i, NULL);
+      const struct sc_stat *all = syscall_stat(NULL, i, NULL);
+
+      /* All zero until the caller made its first syscall */
+      printf("%s", sys_call_table[i]);
+      printf(" calls=%llu errors=%llu",
+             (unsigned long long)own->calls,
+             (unsigned long long)own->errors);
+      if (times)
+         printf(" ns=%llu", (unsigned long long)own->ns);
+      printf(" total_calls=%llu total_errors=%llu",
+             (unsigned long long)all->calls,
+             (unsigned long long)all->errors);
+      if (times)
+         printf(" total_ns=%llu", (unsigned long long)all->ns);
+      printf("\n");
+   }
 
    return 0;
 }
@@ -14,6 +14,72 @@
 
 //typedef char BYTE;
 
+int __sys_memmap(struct pcb_t *caller, struct sc_regs* regs);
+
+/*
+ * sysmem_merge - fold entry b into a when they touch adjacent physical
+ * memory, a copy continuing a copy or a fill continuing a fill
+ */
+static int sysmem_merge(struct sc_regs *a, const struct sc_regs *b)
+{
+   if (a->a1 != b->a1)
+      return 0;
+
+   switch (a->a1) {
+   case SYSMEM_IO_COPY:
+            if (b->a2 != a->a2 + a->a4 || b->a3 != a->a3 + a->a4)
+               return 0;
+            /* An overlapping run would not read what the chunks read */
+            if (a->a3 < a->a2 + a->a4 + b->a4 && a->a2 < a->a3 + a->a4 + b->a4)
+               return 0;
+            break;
+   case SYSMEM_IO_FILL:
+            if (b->a2 != a->a2 + a->a4 || b->a3 != a->a3)
+               return 0;
+            break;
+   default:
+            return 0;
+   }
+
+   a->a4 += b->a4;
+   return 1;
+}
+
+/*
+ * sysmem_batch - run the ops queued in the caller ring, in order
+ * Each entry gets its result in flags. The paging library has already
+ * moved its page tables over to what the ops leave in memory, and each
+ * op only touches the frames it names, so a failing op does not stop
+ * the ones after it. Returns -1 if any op failed, else the number of ops.
+ */
+static int sysmem_batch(struct pcb_t *caller)
+{
+   struct sc_ring *ring = caller->sc_ring;
+   struct sc_regs op;
+   int i, j, n, ret;
+   int failed = 0;
+
+   if (ring == NULL)
+      return 0;
+
+   n = ring->count;
+   ring->count = 0;
+   for (i = 0; i < n; i = j)
+   {
+      op = ring->sqe[i];
+      for (j = i + 1; j < n && sysmem_merge(&op, &ring->sqe[j]); j++)
+         ;
+
+      ret = (op.a1 == SYSMEM_BATCH_OP) ? -1 : __sys_memmap(caller, &op);
+      ring->sqe[i].a3 = op.a3;
+      while (i < j)
+         ring->sqe[i++].flags = ret;
+      if (ret < 0)
+         failed = 1;
+   }
+   return failed ? -1 : n;
+}
+
 int __sys_memmap(struct pcb_t *caller, struct sc_regs* regs)
 {
    int memop = regs->a1;
@@ -21,14 +87,22 @@ int __sys_memmap(struct pcb_t *caller, struct sc_regs* regs)
 
    switch (memop) {
    case SYSMEM_MAP_OP:
-            /* Reserved process case*/
-            break;
+            /* Create or attach the shared region a2 as region a3 */
+            return __mm_shm_map(caller, regs->a2, regs->a3);
+   case SYSMEM_UNMAP_OP:
+            /* Detach the shared region a2, the last user destroys it */
+            return __mm_shm_unmap(caller, regs->a2);
    case SYSMEM_INC_OP:
-            inc_vma_limit(caller, regs->a2, regs->a3);
-            break;
+            return inc_vma_limit(caller, regs->a2, regs->a3);
    case SYSMEM_SWP_OP:
             __mm_swap_page(caller, regs->a2, regs->a3);
             break;
+   case SYSMEM_SWPIN_OP:
+            __mm_swap_in_page(caller, regs->a2, regs->a3);
+            break;
+   case SYSMEM_COW_OP:
+            __mm_cow_page(caller, regs->a2, regs->a3);
+            break;
    case SYSMEM_IO_READ:
             MEMPHY_read(caller->mram, regs->a2, &value);
             regs->a3 = value;
@@ -36,6 +110,14 @@ int __sys_memmap(struct pcb_t *caller, struct sc_regs* regs)
    case SYSMEM_IO_WRITE:
             MEMPHY_write(caller->mram, regs->a2, regs->a3);
             break;
+   case SYSMEM_IO_COPY:
+            /* Physical block a2 to a3 of a4 bytes */
+            return MEMPHY_copy(caller->mram, regs->a2, regs->a3, regs->a4);
+   case SYSMEM_IO_FILL:
+            /* Physical block a2 of a4 bytes set to a3 */
+            return MEMPHY_fill(caller->mram, regs->a2, regs->a3, regs->a4);
+   case SYSMEM_BATCH_OP:
+            return sysmem_batch(caller);
    default:
             printf("Memop code: %d\n", memop);
             break;
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "syscall.h"
+#include "sched.h"
+#include "timer.h"
+
+/*
+ * yield - give the rest of the time slice to the next ready process
+ */
+int __sys_yield(struct pcb_t *caller, struct sc_regs *regs)
+{
+   /* The CPU puts back a ready process once the syscall returns */
+   caller->state = PROC_READY;
+   return 0;
+}
+
+/*
+ * sleep - leave the CPU for a number of time slots
+ * @regs->a1: slots to sleep, 0 only yields
+ */
+int __sys_sleep(struct pcb_t *caller, struct sc_regs *regs)
+{
+   if (regs->a1 == 0)
+      return __sys_yield(caller, regs);
+
+   caller->wake_time = current_time() + regs->a1;
+   sleep_proc(caller);
+   return 0;
+}
@@ -10,6 +10,11 @@
 
 #include "syscall.h"
 #include "common.h"
+#include "mm.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #define __SYSCALL(nr, sym) extern int __##sym(struct pcb_t*,struct sc_regs*);
 #include "syscalltbl.lst"
@@ -26,6 +31,43 @@ const char* sys_call_table[] = {
 #undef  __SYSCALL
 const int syscall_table_size = sizeof(sys_call_table)/sizeof(char*);
 
+/*
+ * Dispatch vector, dense, one entry per slot in table order. The slot
+ * of a syscall number comes from sys_call_slot[], both are generated
+ * from syscall.tbl by syscalltbl.sh. Holes are -1 and go to
+ * __sys_ni_syscall.
+ */
+#define __SYSCALL(nr, sym) SC_SLOT_##sym,
+enum {
+#include "syscalltbl.lst"
+	NR_SC_SLOTS
+};
+#undef  __SYSCALL
+
+#define __SYSCALL(nr, sym) { __##sym, nr, #sym },
+static const struct sc_entry {
+	sys_call_ptr_t handler;
+	uint32_t nr;
+	const char *name;
+} sys_call_vec[] = {
+#include "syscalltbl.lst"
+};
+#undef  __SYSCALL
+
+#define __SYSCALL_NR(nr, slot) slot,
+static const short sys_call_slot[] = {
+#include "syscallnr.lst"
+};
+#undef  __SYSCALL_NR
+
+#define NR_SYSCALLS (sizeof(sys_call_slot) / sizeof(sys_call_slot[0]))
+
+/* Counters of every process together, the per process ones go with
+ * their PCB */
+static struct sc_stat sc_total[NR_SC_SLOTS];
+/* Counters of a process before its first syscall */
+static const struct sc_stat sc_none;
+
 int __sys_ni_syscall(struct pcb_t *caller, struct sc_regs *regs)
 {
    /*
@@ -35,12 +77,180 @@ int __sys_ni_syscall(struct pcb_t *caller, struct sc_regs *regs)
    return 0;
 }
 
-#define __SYSCALL(nr, sym) case nr: return __##sym(caller,regs);
+int syscall_host_times(void)
+{
+	static int enabled = -1;
+
+	/* Racing first callers all read the same environment */
+	if (enabled < 0)
+		enabled = getenv("SYSCALL_TIMES") != NULL;
+	return enabled;
+}
+
+static uint64_t sc_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Account one call, only its PCB touches the caller counters */
+static void sc_account(struct pcb_t *caller, int slot, int ret, uint64_t ns)
+{
+	struct sc_stat *st;
+
+	if (caller->sc_stats == NULL)
+		caller->sc_stats = calloc(NR_SC_SLOTS, sizeof(struct sc_stat));
+	st = &caller->sc_stats[slot];
+	st->calls++;
+	st->errors += ret < 0;
+	st->ns += ns;
+
+	st = &sc_total[slot];
+	__atomic_fetch_add(&st->calls, 1, __ATOMIC_RELAXED);
+	if (ret < 0)
+		__atomic_fetch_add(&st->errors, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&st->ns, ns, __ATOMIC_RELAXED);
+}
+
 int syscall(struct pcb_t *caller, uint32_t nr, struct sc_regs* regs)
 {
-	switch (nr) {
-	#include "syscalltbl.lst"
-	default: return __sys_ni_syscall(caller, regs);
+	const struct sc_entry *sc;
+	uint64_t start;
+	int slot, ret;
+
+	if (nr >= NR_SYSCALLS || (slot = sys_call_slot[nr]) < 0)
+		return __sys_ni_syscall(caller, regs);
+
+	sc = &sys_call_vec[slot];
+	if (!syscall_host_times())
+	{
+		ret = sc->handler(caller, regs);
+		sc_account(caller, slot, ret, 0);
+		return ret;
 	}
+	start = sc_clock_ns();
+	ret = sc->handler(caller, regs);
+	sc_account(caller, slot, ret, sc_clock_ns() - start);
+	return ret;
 };
 
+/*syscall_stat - counters of a syscall
+ *@proc: process, NULL for the whole system
+ *@slot: syscall slot, in [0, syscall_table_size)
+ *@nr: receives the syscall number, may be NULL
+ *
+ * A process that never made a syscall has all its counters at 0
+ */
+const struct sc_stat *syscall_stat(struct pcb_t *proc, int slot, uint32_t *nr)
+{
+	if (nr != NULL)
+		*nr = sys_call_vec[slot].nr;
+	if (proc == NULL)
+		return &sc_total[slot];
+	return proc->sc_stats != NULL ? &proc->sc_stats[slot] : &sc_none;
+}
+
+/*syscall_stat_dump - print the system wide counters of the syscalls used */
+void syscall_stat_dump(void)
+{
+	int slot;
+	int times = syscall_host_times();
+
+	printf("Syscall stats:\n");
+	printf("%4s %-16s %10s %8s", "nr", "name", "calls", "errors");
+	if (times)
+		printf(" %12s %10s", "total_us", "avg_ns");
+	printf("\n");
+	for (slot = 0; slot < NR_SC_SLOTS; slot++)
+	{
+		const struct sc_entry *sc = &sys_call_vec[slot];
+		const struct sc_stat *st = &sc_total[slot];
+
+		if (st->calls == 0)
+			continue;
+		printf("%4u %-16s %10llu %8llu", sc->nr, sc->name,
+		       (unsigned long long)st->calls,
+		       (unsigned long long)st->errors);
+		if (times)
+			printf(" %12llu %10llu",
+			       (unsigned long long)(st->ns / 1000),
+			       (unsigned long long)(st->ns / st->calls));
+		printf("\n");
+	}
+}
+
+/*copy_from_user - copy a block of a user region into the kernel
+ *@caller: process owning the region
+ *@dst: kernel buffer
+ *@rgid: user region ID
+ *@offset: offset in the region
+ *@size: number of bytes, the block must lie in the region
+ */
+int copy_from_user(struct pcb_t *caller, void *dst, uint32_t rgid,
+						 uint32_t offset, size_t size)
+{
+#ifdef MM_PAGING
+	return __read_block(caller, rgid, offset, (BYTE *)dst, size);
+#else
+	return -1;
+#endif
+}
+
+/*copy_to_user - copy a kernel buffer into a block of a user region
+ *@caller: process owning the region
+ *@rgid: user region ID
+ *@offset: offset in the region
+ *@src: kernel buffer
+ *@size: number of bytes, the block must lie in the region
+ */
+int copy_to_user(struct pcb_t *caller, uint32_t rgid, uint32_t offset,
+					  const void *src, size_t size)
+{
+#ifdef MM_PAGING
+	return __write_block(caller, rgid, offset, (const BYTE *)src, size);
+#else
+	return -1;
+#endif
+}
+
+/*strncpy_from_user - copy a NUL terminated string out of a user region
+ *@caller: process owning the region
+ *@dst: kernel buffer of size bytes, always NUL terminated
+ *@rgid: user region ID, the string starts at offset 0
+ *@size: size of dst
+ *
+ * Reading stops at the NUL, at the end of the region or when dst is
+ * full, one page chunk at a time. Return the string length or -1.
+ */
+int strncpy_from_user(struct pcb_t *caller, char *dst, uint32_t rgid, size_t size)
+{
+#ifdef MM_PAGING
+	int rgsz = __rg_size(caller, rgid);
+	size_t len = 0, chunk;
+	char *nul;
+
+	if (rgsz < 0 || size == 0)
+		return -1;
+	if ((size_t)rgsz < size - 1)
+		size = rgsz + 1;
+
+	while (len < size - 1)
+	{
+		/* Page sized chunks, so nothing much past the NUL is translated */
+		chunk = PAGING_PAGESZ;
+		if (chunk > size - 1 - len)
+			chunk = size - 1 - len;
+		if (__read_block(caller, rgid, len, (BYTE *)dst + len, chunk) != 0)
+			return -1;
+		if ((nul = memchr(dst + len, '\0', chunk)) != NULL)
+			return nul - dst;
+		len += chunk;
+	}
+	dst[len] = '\0';
+	return len;
+#else
+	return -1;
+#endif
+}
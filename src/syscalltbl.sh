@@ -9,21 +9,23 @@
 set -e
 
 usage() {
-	echo >&2 "usage: $0 INFILE OUTFILE" >&2
+	echo >&2 "usage: $0 INFILE OUTFILE NRFILE" >&2
 	echo >&2
 	echo >&2 "  INFILE    input syscall table"
-	echo >&2 "  OUTFILE   output lst file"
+	echo >&2 "  OUTFILE   output lst file, one entry per syscall"
+	echo >&2 "  NRFILE    output lst file, the slot of every syscall number"
 	echo >&2
 	exit 1
 }
 
 
-if [ $# -ne 2 ]; then
+if [ $# -ne 3 ]; then
 	usage
 fi
 
 infile="$1"
 outfile="$2"
+nrfile="$3"
 
 nxt=0
 
@@ -37,3 +39,22 @@ grep -E "^[0-9]+[[:space:]]+" "$infile" | sort -n | {
 		nxt=$((nr + 1))
 	done
 } > "$outfile"
+
+# Dense map from syscall number to slot, the entry order of OUTFILE.
+# Holes and entries without an entry point get slot -1
+grep -E "^[0-9]+[[:space:]]+" "$infile" | sort -n | {
+
+	nxt=0
+	slot=0
+	while read nr name native ; do
+
+		[ -n "$native" ] || continue
+		while [ $nxt -lt $nr ]; do
+			echo "__SYSCALL_NR($nxt, -1)"
+			nxt=$((nxt + 1))
+		done
+		echo "__SYSCALL_NR($nr, $slot)"
+		slot=$((slot + 1))
+		nxt=$((nr + 1))
+	done
+} > "$nrfile"
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# gencfg.sh - generate a simulator config with many process arrivals
+#
+# Usage: tools/gencfg.sh [-n arrivals] [-c cpus] [-t time slot]
+#                        [-g max gap] [-r ram size] [-w swap size]
+#                        [-p max prio] [-s seed] program...
+#
+# Arrival times grow by a random gap in [0, max gap], each arrival runs
+# one of the given programs (names under input/proc) picked at random
+# with a random priority in [0, max prio). The config goes to stdout:
+#
+#   tools/gencfg.sh -n 1000000 -c 4 s0 s1 p0s > input/os_scale
+#
+
+n=1000 cpus=4 slot=2 gap=1 ram=1048576 swp=16777216 prio=140 seed=1
+
+usage() {
+	sed -n '5,7p' "$0" | sed 's/^# //' >&2
+	exit 2
+}
+
+while getopts n:c:t:g:r:w:p:s: opt; do
+	case $opt in
+	n) n=$OPTARG ;;
+	c) cpus=$OPTARG ;;
+	t) slot=$OPTARG ;;
+	g) gap=$OPTARG ;;
+	r) ram=$OPTARG ;;
+	w) swp=$OPTARG ;;
+	p) prio=$OPTARG ;;
+	s) seed=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -gt 0 ] || usage
+
+echo "$slot $cpus $n"
+echo "$ram $swp 0 0 0"
+awk -v n="$n" -v gap="$gap" -v prio="$prio" -v seed="$seed" -v progs="$*" '
+BEGIN {
+	srand(seed)
+	np = split(progs, prog, " ")
+	t = 0
+	for (i = 0; i < n; i++) {
+		printf "%d %s %d\n", t, prog[int(rand() * np) + 1], int(rand() * prio)
+		t += int(rand() * (gap + 1))
+	}
+}'
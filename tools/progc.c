@@ -0,0 +1,37 @@
+/*
+ * progc - compile text programs into packed program images
+ *
+ * Usage: progc <program> <image>
+ *
+ * The image holds the priority, the instruction count and the decoded
+ * struct inst_t array, so the loader maps it instead of parsing text.
+ * Point a configuration line at the image path to use it.
+ */
+
+#include "loader.h"
+
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+	struct code_seg_t *code;
+	uint32_t priority;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <program> <image>\n", argv[0]);
+		return 2;
+	}
+
+	if ((code = load_code(argv[1], &priority)) == NULL)
+		return 1;
+
+	if (save_code(argv[2], priority, code) != 0) {
+		fprintf(stderr, "%s: cannot write '%s'\n", argv[0], argv[2]);
+		free_code(code);
+		return 1;
+	}
+
+	printf("%s: %u instructions, priority %u\n", argv[2], code->size, priority);
+	free_code(code);
+	return 0;
+}